@@ -0,0 +1,372 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "jpcre2.h"
+
+///Allocation regression check, run by: make check
+///Every public entry point is run a number of times and the heap allocations, bytes and
+///blocks left allocated per call are compared with alloc_baseline.txt. It fails if any of them grew.
+///After a change that is meant to allocate more (or less), record new numbers with: make alloc-baseline
+///
+///   ./jpcre2alloc [baseline file] [--update]
+///
+///The numbers depend on the PCRE2 version and the C++ library. For the C++ library, allocations may
+///grow by ALLOCS_SLACK percent and bytes by BYTES_SLACK percent, so an entry point that doesn't
+///allocate must go on not allocating, and leak counts must not grow at all. A baseline recorded
+///with another PCRE2 version isn't compared, the check is skipped.
+
+
+///malloc(), calloc(), realloc() and free() are interposed (glibc only, the check is skipped elsewhere).
+///operator new and delete go through them too, so STL allocations are counted as well.
+static std::atomic<unsigned long> alloc_count(0);
+static std::atomic<unsigned long> alloc_bytes(0);
+static std::atomic<unsigned long> free_count(0);
+
+#if defined(__GLIBC__)
+#define ALLOC_CHECK_SUPPORTED 1
+extern "C" {
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t n,size_t size);
+    void* __libc_realloc(void* p,size_t size);
+    void __libc_free(void* p);
+
+    static void countAlloc(size_t size){
+        alloc_count.fetch_add(1,std::memory_order_relaxed);
+        alloc_bytes.fetch_add(size,std::memory_order_relaxed);
+    }
+
+    void* malloc(size_t size)               {countAlloc(size); return __libc_malloc(size);}
+    void* calloc(size_t n,size_t size)      {countAlloc(n*size); return __libc_calloc(n,size);}
+    void free(void* p)                      {if(p) free_count.fetch_add(1,std::memory_order_relaxed); __libc_free(p);}
+    ///A realloc() is counted as a new block replacing the old one
+    void* realloc(void* p,size_t size){
+        if(size) countAlloc(size);
+        if(p) free_count.fetch_add(1,std::memory_order_relaxed);
+        return __libc_realloc(p,size);
+    }
+}
+#endif
+
+
+static const int ITERATIONS=20;
+static const double ALLOCS_SLACK=10;
+static const double BYTES_SLACK=10;
+
+struct Usage{
+    double allocs,bytes,leaked;     ///per call
+};
+
+typedef std::map<std::string,Usage> Usages;
+
+static Usages measured;
+static std::vector<std::string> order;
+
+
+///Runs op ITERATIONS times after a warm up call (which fills pools, caches and output vectors)
+template<class Op>
+static void measure(const std::string& name,Op op){
+    op();
+    unsigned long a0=alloc_count.load(),b0=alloc_bytes.load(),f0=free_count.load();
+    for(int i=0;i<ITERATIONS;i++) op();
+    unsigned long a=alloc_count.load()-a0,b=alloc_bytes.load()-b0,f=free_count.load()-f0;
+    Usage u;
+    u.allocs=(double)a/ITERATIONS;
+    u.bytes=(double)b/ITERATIONS;
+    u.leaked=a>f?(double)(a-f)/ITERATIONS:0;
+    measured[name]=u;
+    order.push_back(name);
+}
+
+
+///true if u is over the baseline b in allocations, bytes or blocks left allocated
+static bool overBaseline(const Usage& u,const Usage& b){
+    ///baseline values are rounded to 2 decimals and whole bytes
+    return u.allocs > b.allocs*(1+ALLOCS_SLACK/100)+0.005 || u.bytes > b.bytes*(1+BYTES_SLACK/100)+0.5 || u.leaked > b.leaked+0.005;
+}
+
+///The check is only as good as the counting: one allocation per call, and one block left per call,
+///must be seen as such, and a call over its baseline must be caught. A malloc() that isn't
+///interposed (e.g a C library that calls its own) would let every entry point pass.
+static bool selfCheck(){
+    static std::vector<void*> kept;
+    static void* volatile last;         ///a malloc() and free() pair may be optimized away otherwise
+    kept.reserve(ITERATIONS+1);
+    measure("self/alloc",[]{last=std::malloc(100); std::free(last);});
+    measure("self/leak",[]{kept.push_back(std::malloc(100));});
+    for(size_t i=0;i<kept.size();i++) std::free(kept[i]);
+    
+    const Usage& a=measured["self/alloc"];
+    const Usage& l=measured["self/leak"];
+    Usage exact={1,100,0},none={0,0,0},twice={2,200,0};
+    bool ok = a.allocs==1 && a.leaked==0 && l.allocs==1 && l.leaked==1 &&
+              !overBaseline(a,exact) && overBaseline(a,none) && overBaseline(l,exact) && overBaseline(twice,exact);
+    measured.clear();
+    order.clear();
+    return ok;
+}
+
+
+static std::string pcre2Version(){
+    std::ostringstream v;
+    v<<PCRE2_MAJOR<<"."<<PCRE2_MINOR;
+    return v.str();
+}
+
+static const std::string RECORDED_WITH="#Recorded with PCRE2 ";
+
+///Reads the numbers, and into version the PCRE2 version writeBaseline() noted (empty if there's none)
+static bool readBaseline(const std::string& path,Usages& base,std::string& version){
+    std::ifstream in(path.c_str());
+    if(!in) return false;
+    std::string line;
+    while(std::getline(in,line)){
+        if(line.compare(0,RECORDED_WITH.size(),RECORDED_WITH)==0){
+            version=line.substr(RECORDED_WITH.size());
+            version=version.substr(0,version.find(','));
+        }
+        if(line.empty() || line[0]=='#') continue;
+        std::istringstream ls(line);
+        std::string name;
+        Usage u;
+        if(ls>>name>>u.allocs>>u.bytes>>u.leaked) base[name]=u;
+    }
+    return true;
+}
+
+static bool writeBaseline(const std::string& path){
+    std::ofstream out(path.c_str());
+    if(!out) return false;
+    out<<"#Heap usage per call of the public entry points, checked by make check (src/alloc_check.cpp)."<<std::endl
+       <<RECORDED_WITH<<pcre2Version()<<", regenerate with: make alloc-baseline"<<std::endl
+       <<"#name allocs bytes leaked"<<std::endl;
+    out<<std::fixed;
+    for(size_t i=0;i<order.size();i++){
+        const Usage& u=measured[order[i]];
+        out<<order[i]<<" "<<std::setprecision(2)<<u.allocs<<" "<<std::setprecision(0)<<u.bytes
+           <<" "<<std::setprecision(2)<<u.leaked<<std::endl;
+    }
+    return (bool)out;
+}
+
+
+static void runAll(){
+    const std::string pat_email="(?<user>[\\w.]+)@(?<domain>[\\w.]+)\\.(?<tld>[a-z]+)";
+    const std::string pat_num="(\\d+)";
+    std::string subject;
+    for(int i=0;i<200;i++) subject+="line "+jpcre2_utils::toString(i)+" mail user"+jpcre2_utils::toString(i)+"@example.com\n";
+    const std::string small="mail to user42@example.com now";
+
+    ///--- compile ---
+    jpcre2::RegexCache::setCapacity(0);
+    measure("compile",[&]{
+        jpcre2::Regex re;
+        re.compile(pat_email,"").execute();
+    });
+    measure("compile/S",[&]{
+        jpcre2::Regex re;
+        re.compile(pat_email,"S").execute();
+    });
+    jpcre2::RegexCache::setCapacity(64);
+    measure("compile/cached",[&]{
+        jpcre2::Regex re;
+        re.compile(pat_email,"S").execute();
+    });
+    jpcre2::RegexCache::setCapacity(0);
+
+    for(int jit=0;jit<2;jit++){
+        std::string tag=jit?"/S":"";
+        jpcre2::Regex re_email,re_num;
+        re_email.compile(pat_email,jit?"S":"").execute();
+        re_num.compile(pat_num,jit?"S":"").execute();
+
+        ///--- RegexMatch ---
+        jpcre2::RegexMatch rm(re_email);
+        rm.subject(&small);
+        measure("match/test"+tag,[&]{rm.test();});
+        measure("match/count"+tag,[&]{rm.count();});
+
+        jpcre2::VecNum vec_num;
+        jpcre2::VecNas vec_nas;
+        jpcre2::VecNtN vec_ntn;
+        jpcre2::VecSpan vec_span;
+        jpcre2::MatchSet match_set;
+        measure("match/numbered"+tag,[&]{
+            jpcre2::RegexMatch m(re_email);
+            m.subject(&small).numberedSubstringVector(vec_num).execute();
+        });
+        measure("match/named"+tag,[&]{
+            jpcre2::RegexMatch m(re_email);
+            m.subject(&small).namedSubstringVector(vec_nas).execute();
+        });
+        measure("match/all-vectors"+tag,[&]{
+            jpcre2::RegexMatch m(re_email);
+            m.subject(&small).numberedSubstringVector(vec_num).namedSubstringVector(vec_nas)
+             .nameToNumberMapVector(vec_ntn).execute();
+        });
+        measure("match/Regex::match"+tag,[&]{
+            re_email.match(small).numberedSubstringVector(vec_num).execute();
+        });
+
+        measure("findAll/count"+tag,[&]{
+            jpcre2::RegexMatch m(re_num);
+            m.subject(&subject).count();
+        });
+        measure("findAll/numbered"+tag,[&]{
+            jpcre2::RegexMatch m(re_num);
+            m.subject(&subject).findAll().numberedSubstringVector(vec_num).execute();
+        });
+        measure("findAll/named"+tag,[&]{
+            jpcre2::RegexMatch m(re_email);
+            m.subject(&subject).findAll().namedSubstringVector(vec_nas).execute();
+        });
+        measure("findAll/spans"+tag,[&]{
+            jpcre2::RegexMatch m(re_num);
+            m.subject(&subject).findAll().numberedSpanVector(vec_span).execute();
+        });
+        measure("findAll/MatchSet"+tag,[&]{
+            jpcre2::RegexMatch m(re_num);
+            m.subject(&subject).findAll().matchSet(match_set).execute();
+        });
+        measure("findAll/iterate"+tag,[&]{
+            jpcre2::RegexMatch m(re_num);
+            m.subject(&subject).findAll();
+            jpcre2::Uint n=0;
+            for(const jpcre2::MatchView& v : m.iterate()) n+=v.length(0);
+        });
+        std::istringstream in(subject);
+        measure("findAll/executeStream"+tag,[&]{
+            in.clear();
+            in.seekg(0);
+            jpcre2::RegexMatch m(re_num);
+            m.findAll().executeStream(in,[](const jpcre2::MatchView&){return true;});
+        });
+
+        ///--- RegexReplace ---
+        std::string out;
+        measure("replace"+tag,[&]{
+            jpcre2::RegexReplace r(re_num);
+            r.subject(&subject).replaceWith("[$1]").execute(out);
+        });
+        measure("replace/g"+tag,[&]{
+            jpcre2::RegexReplace r(re_num);
+            r.subject(&subject).replaceWith("[$1]").modifiers("g").execute(out);
+        });
+        measure("replace/g-String"+tag,[&]{
+            out=re_num.replace(subject,"[$1]").modifiers("g").execute();
+        });
+        measure("replace/g-sink"+tag,[&]{
+            jpcre2::RegexReplace r(re_num);
+            r.subject(&subject).replaceWith("[$1]").modifiers("g").execute([](const char*,jpcre2::Uint){});
+        });
+        measure("replace/g-evaluator"+tag,[&]{
+            jpcre2::RegexReplace r(re_num);
+            r.subject(&subject).modifiers("g").evaluator([](const jpcre2::MatchView& v){return v.str(1);}).execute(out);
+        });
+        int fd=open("/dev/null",O_WRONLY);
+        if(fd>=0){
+            measure("replace/g-fd"+tag,[&]{
+                jpcre2::RegexReplace r(re_num);
+                r.subject(&subject).replaceWith("[$1]").modifiers("g").executeFd(fd);
+            });
+            close(fd);
+        }
+    }
+
+    ///--- RegexSet ---
+    jpcre2::RegexSet set;
+    set.add(pat_email).add(pat_num).add("ERROR \\d+").add("^line");
+    std::vector<jpcre2::Uint> matched;
+    measure("RegexSet/match",[&]{set.match(small,matched);});
+}
+
+
+int main(int argc,char** argv){
+    std::string path="alloc_baseline.txt";
+    bool update=false;
+    for(int i=1;i<argc;i++){
+        if(std::strcmp(argv[i],"--update")==0) update=true;
+        else path=argv[i];
+    }
+
+    #ifndef ALLOC_CHECK_SUPPORTED
+    std::cout<<"jpcre2alloc: allocations can only be counted with glibc, skipped"<<std::endl;
+    return 0;
+    #endif
+
+    if(!selfCheck()){
+        std::cerr<<"jpcre2alloc: allocations aren't counted as they should be, nothing can be checked"<<std::endl;
+        return 1;
+    }
+
+    try{
+        runAll();
+    }
+    catch(int e){
+        std::cerr<<"jpcre2alloc: error "<<e<<" thrown"<<std::endl;
+        return 1;
+    }
+
+    if(update){
+        if(!writeBaseline(path)){
+            std::cerr<<"jpcre2alloc: can not write "<<path<<std::endl;
+            return 1;
+        }
+        std::cout<<"jpcre2alloc: recorded "<<order.size()<<" entry points in "<<path<<std::endl;
+        return 0;
+    }
+
+    Usages base;
+    std::string version;
+    if(!readBaseline(path,base,version)){
+        std::cerr<<"jpcre2alloc: can not read "<<path<<", record it with: make alloc-baseline"<<std::endl;
+        return 1;
+    }
+    if(!version.empty() && version!=pcre2Version()){
+        std::cout<<"jpcre2alloc: "<<path<<" was recorded with PCRE2 "<<version<<", this is PCRE2 "<<pcre2Version()
+                 <<", the numbers can't be compared, skipped."<<std::endl
+                 <<"To check against this version, record its numbers with: make alloc-baseline"<<std::endl;
+        return 0;
+    }
+
+    int failed=0;
+    std::cout<<std::left<<std::setw(28)<<"entry point"<<std::right<<std::setw(18)<<"allocs"
+             <<std::setw(22)<<"bytes"<<std::setw(16)<<"leaked"<<std::endl;
+    std::cout<<std::fixed;
+    for(size_t i=0;i<order.size();i++){
+        const std::string& name=order[i];
+        const Usage& u=measured[name];
+        Usages::const_iterator it=base.find(name);
+        std::cout<<std::left<<std::setw(28)<<name<<std::right;
+        if(it==base.end()){
+            std::cout<<std::setprecision(2)<<std::setw(18)<<u.allocs<<std::setprecision(0)<<std::setw(22)<<u.bytes
+                     <<std::setprecision(2)<<std::setw(16)<<u.leaked<<"  no baseline"<<std::endl;
+            failed++;
+            continue;
+        }
+        const Usage& b=it->second;
+        std::ostringstream a,by,l;
+        a<<std::fixed<<std::setprecision(2)<<u.allocs<<"/"<<b.allocs;
+        by<<std::fixed<<std::setprecision(0)<<u.bytes<<"/"<<b.bytes;
+        l<<std::fixed<<std::setprecision(2)<<u.leaked<<"/"<<b.leaked;
+        std::cout<<std::setw(18)<<a.str()<<std::setw(22)<<by.str()<<std::setw(16)<<l.str();
+        if(overBaseline(u,b)){
+            std::cout<<"  FAIL";
+            failed++;
+        }
+        std::cout<<std::endl;
+    }
+
+    if(failed){
+        std::cout<<std::endl<<"jpcre2alloc: "<<failed<<" entry point(s) allocate more than "<<path<<" allows."<<std::endl
+                 <<"If that's intended, record new numbers with: make alloc-baseline"<<std::endl;
+        return 1;
+    }
+    std::cout<<std::endl<<"jpcre2alloc: all "<<order.size()<<" entry points within the baseline"<<std::endl;
+    return 0;
+}
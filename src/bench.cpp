@@ -0,0 +1,280 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include "jpcre2.h"
+
+///Microbenchmarks for the compile, match, findAll and replace paths, run by: make bench
+///Each wrapper benchmark runs next to the same work done with raw PCRE2 calls,
+///the difference is the cost of the wrapper.
+///
+///   ./jpcre2bench [seconds per benchmark (default 0.3)] [name filter]
+///
+///It fails if a wrapper call finds other matches or makes another result than the raw calls.
+
+
+///Allocations are counted by interposing malloc() (glibc only, "-" elsewhere).
+///operator new goes through malloc() too, so STL allocations are counted as well.
+static std::atomic<unsigned long> alloc_count(0);
+
+#if defined(__GLIBC__)
+#define BENCH_COUNT_ALLOCS 1
+extern "C" {
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t n,size_t size);
+    void* __libc_realloc(void* p,size_t size);
+
+    void* malloc(size_t size)               {alloc_count.fetch_add(1,std::memory_order_relaxed); return __libc_malloc(size);}
+    void* calloc(size_t n,size_t size)      {alloc_count.fetch_add(1,std::memory_order_relaxed); return __libc_calloc(n,size);}
+    void* realloc(void* p,size_t size)      {alloc_count.fetch_add(1,std::memory_order_relaxed); return __libc_realloc(p,size);}
+}
+#endif
+
+
+static double min_seconds=0.3;
+static std::string filter;
+
+///Keeps results alive so the work isn't optimized away
+static volatile size_t sink_value;
+
+///Runs op (which does one operation per call) in growing batches until min_seconds have passed,
+///then prints ns/op, MB/s (if bytes per op is given) and allocations per op.
+template<class Op>
+static void bench(const std::string& name,size_t bytes,Op op){
+    if(!filter.empty() && name.find(filter)==std::string::npos) return;
+
+    op();       ///warm up: JIT stacks, pools and caches are filled once
+
+    typedef std::chrono::steady_clock Clock;
+    unsigned long iters=1;
+    double secs=0;
+    unsigned long allocs=0;
+    for(;;){
+        unsigned long a0=alloc_count.load();
+        Clock::time_point t0=Clock::now();
+        for(unsigned long i=0;i<iters;i++) op();
+        Clock::time_point t1=Clock::now();
+        allocs=alloc_count.load()-a0;
+        secs=std::chrono::duration<double>(t1-t0).count();
+        if(secs>=min_seconds || iters>=(1ul<<40)) break;
+        ///aim a bit past min_seconds, growing at most 10 times per round
+        double grow = secs>0 ? min_seconds*1.2/secs : 10;
+        iters=(unsigned long)(iters*(grow>10?10:(grow<2?2:grow)));
+    }
+
+    double ns=secs*1e9/iters;
+    std::cout<<std::left<<std::setw(40)<<name<<std::right<<std::fixed
+             <<std::setw(14)<<std::setprecision(1)<<ns<<" ns/op";
+    if(bytes) std::cout<<std::setw(12)<<std::setprecision(1)<<bytes/(ns/1e9)/1e6<<" MB/s";
+    else std::cout<<std::setw(17)<<"";
+    #ifdef BENCH_COUNT_ALLOCS
+    std::cout<<std::setw(12)<<std::setprecision(2)<<(double)allocs/iters<<" allocs/op";
+    #else
+    std::cout<<std::setw(12)<<"-"<<" allocs/op";
+    #endif
+    std::cout<<std::endl;
+}
+
+
+///The wrapper must do the same work as the raw calls it's compared with, checked once before timing.
+///make check runs the benchmarks for a moment to check that.
+static bool mismatch=false;
+
+template<class T>
+static void expectSame(const std::string& name,const T& raw,const T& wrapped){
+    if(raw==wrapped) return;
+    std::cerr<<name<<": jpcre2 gives another result than raw PCRE2"<<std::endl;
+    mismatch=true;
+}
+
+
+///Raw PCRE2: everything a careful caller would set up once
+struct RawPattern{
+    pcre2_code* code;
+    pcre2_match_data* match_data;
+
+    RawPattern(const std::string& pat,uint32_t opts,bool jit){
+        int err; PCRE2_SIZE off;
+        code=pcre2_compile((PCRE2_SPTR)pat.data(),pat.size(),opts,&err,&off,NULL);
+        if(!code){std::cerr<<"compile failed: "<<pat<<std::endl; std::exit(1);}
+        if(jit) pcre2_jit_compile(code,PCRE2_JIT_COMPLETE);
+        match_data=pcre2_match_data_create_from_pattern(code,NULL);
+    }
+    ~RawPattern(){pcre2_match_data_free(match_data);pcre2_code_free(code);}
+
+    ///The global loop of pcre2demo, without the empty match retry (the patterns here can't match empty)
+    size_t findAll(const std::string& s){
+        size_t count=0;
+        PCRE2_SIZE start=0;
+        PCRE2_SIZE* ov=pcre2_get_ovector_pointer(match_data);
+        while(pcre2_match(code,(PCRE2_SPTR)s.data(),s.size(),start,0,match_data,NULL)>0){
+            count++;
+            start=ov[1];
+        }
+        return count;
+    }
+};
+
+
+///A log like subject: size bytes of lines, some of them with an e-mail address and an error code
+static std::string makeSubject(size_t size){
+    static const char* words[]={"alpha","beta","gamma","delta","request","served","in","ms","user","GET","POST","/index.html"};
+    std::string s;
+    s.reserve(size+128);
+    unsigned seed=12345;
+    size_t line=0;
+    while(s.size()<size){
+        seed=seed*1103515245+12345;
+        s+="2016-10-12 10:";
+        s+=jpcre2_utils::toString(10+line%50);
+        for(int w=0;w<8;w++){s+=' ';s+=words[(seed>>(w*3))%12];}
+        if(line%7==0) s+=" user"+jpcre2_utils::toString(line)+"@example.com";
+        if(line%5==0) s+=" ERROR "+jpcre2_utils::toString(100+line%400);
+        s+='\n';
+        line++;
+    }
+    return s;
+}
+
+
+int main(int argc,char** argv){
+    if(argc>1) min_seconds=std::atof(argv[1]);
+    if(argc>2) filter=argv[2];
+    if(min_seconds<=0) min_seconds=0.3;
+
+    jpcre2::RegexCache::setCapacity(0);     ///compile benchmarks must really compile
+
+    const std::string pat_email="(?<user>[\\w.]+)@(?<domain>[\\w.]+)\\.(?<tld>[a-z]+)";
+    const std::string pat_error="ERROR (\\d+)";
+    const std::string small="served in 12 ms to user42@example.com from 10.0.0.1";
+    const std::string large=makeSubject(1<<20);
+
+    std::cout<<"subject sizes: single "<<small.size()<<" bytes, large "<<large.size()<<" bytes"<<std::endl<<std::endl;
+
+    ///--- compile ---
+    bench("compile/raw",0,[&]{
+        int err; PCRE2_SIZE off;
+        pcre2_code* c=pcre2_compile((PCRE2_SPTR)pat_email.data(),pat_email.size(),0,&err,&off,NULL);
+        pcre2_code_free(c);
+    });
+    bench("compile/jpcre2",0,[&]{
+        jpcre2::Regex re;
+        re.compile(pat_email,"").execute();
+    });
+    bench("compile/raw+jit",0,[&]{
+        int err; PCRE2_SIZE off;
+        pcre2_code* c=pcre2_compile((PCRE2_SPTR)pat_email.data(),pat_email.size(),0,&err,&off,NULL);
+        pcre2_jit_compile(c,PCRE2_JIT_COMPLETE);
+        pcre2_code_free(c);
+    });
+    bench("compile/jpcre2 S",0,[&]{
+        jpcre2::Regex re;
+        re.compile(pat_email,"S").execute();
+    });
+    jpcre2::RegexCache::setCapacity(64);
+    bench("compile/jpcre2 S (cached)",0,[&]{
+        jpcre2::Regex re;
+        re.compile(pat_email,"S").execute();
+    });
+    jpcre2::RegexCache::setCapacity(0);
+
+    for(int jit=0;jit<2;jit++){
+        std::string tag=jit?" S":"";
+        std::cout<<std::endl;
+
+        RawPattern raw_email(pat_email,0,jit!=0);
+        RawPattern raw_error(pat_error,0,jit!=0);
+        jpcre2::Regex re_email,re_error;
+        re_email.compile(pat_email,jit?"S":"").execute();
+        re_error.compile(pat_error,jit?"S":"").execute();
+
+        ///--- single match ---
+        bench("match/raw"+tag,small.size(),[&]{
+            sink_value=pcre2_match(raw_email.code,(PCRE2_SPTR)small.data(),small.size(),0,0,raw_email.match_data,NULL);
+        });
+        jpcre2::RegexMatch rm_small(re_email);
+        rm_small.subject(&small);
+        bench("match/jpcre2 test()"+tag,small.size(),[&]{
+            sink_value=rm_small.test();
+        });
+        jpcre2::VecNum vec_num;
+        rm_small.numberedSubstringVector(vec_num);
+        bench("match/jpcre2 numbered"+tag,small.size(),[&]{
+            sink_value=rm_small.execute();
+        });
+        jpcre2::VecNas vec_nas;
+        jpcre2::RegexMatch rm_named(re_email);
+        rm_named.subject(&small).namedSubstringVector(vec_nas);
+        bench("match/jpcre2 named"+tag,small.size(),[&]{
+            sink_value=rm_named.execute();
+        });
+
+        ///--- findAll on a large subject ---
+        bench("findAll/raw"+tag,large.size(),[&]{
+            sink_value=raw_error.findAll(large);
+        });
+        jpcre2::RegexMatch rm_large(re_error);
+        rm_large.subject(&large);
+        bench("findAll/jpcre2 count()"+tag,large.size(),[&]{
+            sink_value=rm_large.count();
+        });
+        jpcre2::MatchSet match_set;
+        jpcre2::RegexMatch rm_set(re_error);
+        rm_set.subject(&large).findAll().matchSet(match_set);
+        bench("findAll/jpcre2 MatchSet"+tag,large.size(),[&]{
+            sink_value=rm_set.execute();
+        });
+        jpcre2::VecNum all_num;
+        jpcre2::RegexMatch rm_num(re_error);
+        rm_num.subject(&large).findAll().numberedSubstringVector(all_num);
+        bench("findAll/jpcre2 numbered"+tag,large.size(),[&]{
+            sink_value=rm_num.execute();
+        });
+        bench("findAll/raw named pattern"+tag,large.size(),[&]{
+            sink_value=raw_email.findAll(large);
+        });
+        jpcre2::VecNas all_nas;
+        jpcre2::RegexMatch rm_nas(re_email);
+        rm_nas.subject(&large).findAll().namedSubstringVector(all_nas);
+        expectSame("findAll"+tag,raw_error.findAll(large),rm_large.count());
+        expectSame("findAll MatchSet"+tag,raw_error.findAll(large),rm_set.execute());
+        expectSame("findAll numbered"+tag,raw_error.findAll(large),rm_num.execute());
+        expectSame("findAll named"+tag,raw_email.findAll(large),rm_nas.execute());
+        bench("findAll/jpcre2 named"+tag,large.size(),[&]{
+            sink_value=rm_nas.execute();
+        });
+
+        ///--- global replace ---
+        const std::string repl="E[$1]";
+        std::string raw_out(large.size()*2,'\0');
+        bench("replace g/raw"+tag,large.size(),[&]{
+            PCRE2_SIZE len=raw_out.size();
+            sink_value=pcre2_substitute(raw_error.code,(PCRE2_SPTR)large.data(),large.size(),0,PCRE2_SUBSTITUTE_GLOBAL,
+                                        raw_error.match_data,NULL,(PCRE2_SPTR)repl.data(),repl.size(),
+                                        (PCRE2_UCHAR*)&raw_out[0],&len);
+        });
+        jpcre2::RegexReplace rr(re_error);
+        rr.subject(&large).replaceWith(repl).modifiers("g");
+        std::string out;
+        {
+            PCRE2_SIZE len=raw_out.size();
+            pcre2_substitute(raw_error.code,(PCRE2_SPTR)large.data(),large.size(),0,PCRE2_SUBSTITUTE_GLOBAL,
+                             raw_error.match_data,NULL,(PCRE2_SPTR)repl.data(),repl.size(),(PCRE2_UCHAR*)&raw_out[0],&len);
+            std::string expected(raw_out,0,len),streamed;
+            rr.execute(out);
+            rr.execute([&streamed](const char* data,jpcre2::Uint size){streamed.append(data,size);});
+            expectSame("replace g"+tag,expected,out);
+            expectSame("replace g sink"+tag,expected,streamed);
+        }
+        bench("replace g/jpcre2"+tag,large.size(),[&]{
+            rr.execute(out);
+            sink_value=out.size();
+        });
+        bench("replace g/jpcre2 sink"+tag,large.size(),[&]{
+            size_t n=0;
+            rr.execute([&n](const char*,jpcre2::Uint size){n+=size;});
+            sink_value=n;
+        });
+    }
+    return mismatch?1:0;
+}
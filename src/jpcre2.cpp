@@ -41,25 +41,72 @@ Dsclaimer:
 
 #include "jpcre2.h"
 
-    template<typename T>
-    jpcre2::String jpcre2_utils::toString(T a){
-        std::stringstream ss;
-        ss <<a;
-        return ss.str();
+    pcre2_match_data* jpcre2::MatchDataPool::checkout(const pcre2_code* code,pcre2_general_context* gcontext){
+        for(int i=0;i<SLOTS;i++){
+            pcre2_match_data* match_data=slots[i].exchange(nullptr,std::memory_order_acquire);
+            if(match_data) return match_data;
+        }
+        ///Pool is empty or all blocks are checked out by other threads
+        return pairs ? pcre2_match_data_create(pairs, gcontext) : pcre2_match_data_create_from_pattern(code, NULL);
+    }
+    
+    void jpcre2::MatchDataPool::checkin(pcre2_match_data* match_data){
+        if(!match_data) return;
+        for(int i=0;i<SLOTS;i++){
+            pcre2_match_data* expected=nullptr;
+            if(slots[i].compare_exchange_strong(expected,match_data,std::memory_order_release,std::memory_order_relaxed))
+                return;
+        }
+        ///Pool is full
+        pcre2_match_data_free(match_data);
+    }
+    
+    void jpcre2::MatchDataPool::clear(){
+        for(int i=0;i<SLOTS;i++){
+            pcre2_match_data* match_data=slots[i].exchange(nullptr,std::memory_order_acquire);
+            if(match_data) pcre2_match_data_free(match_data);
+        }
     }
 
+    ///PCRE2 memory functions of a Regex with a user allocator
+    static void* allocatorMalloc(PCRE2_SIZE size,void* data){
+        return static_cast<jpcre2::Allocator*>(data)->allocate(size);
+    }
+    static void allocatorFree(void* p,void* data){
+        if(p) static_cast<jpcre2::Allocator*>(data)->deallocate(p);
+    }
+    
+    jpcre2::Regex& jpcre2::Regex::allocator(Allocator* alloc){
+        if(gcontext) pcre2_general_context_free(gcontext);
+        gcontext=alloc?pcre2_general_context_create(allocatorMalloc,allocatorFree,alloc):nullptr;
+        user_allocator=alloc;
+        ///Blocks of the old allocator; the ones sized for the pattern go with the next compile
+        md_pool_min.clear();
+        return *this;
+    }
+    
     jpcre2::String jpcre2::Regex::getErrorMessage(){
         return getErrorMessage(error_code);
     }
     
     jpcre2::String jpcre2::Regex::getErrorMessage(int err_num){
+        return errorMessage(err_num,jpcre2_error_offset,error_offset);
+    }
+    
+    jpcre2::String jpcre2::Regex::errorMessage(int err_num,int jpcre2_err_offset,PCRE2_SIZE err_offset){
         if(err_num==ERROR::INVALID_MODIFIER){
-            return "Invalid Modifier: "+jpcre2_utils::toString((char)jpcre2_error_offset);
+            return "Invalid Modifier: "+jpcre2_utils::toString((char)jpcre2_err_offset);
+        }
+        else if(err_num==ERROR::FILE_ERROR){
+            return "File error: "+jpcre2_utils::toString(std::strerror(jpcre2_err_offset));
+        }
+        else if(err_num==ERROR::TIME_LIMIT){
+            return "Time limit reached";
         }
         else{
             PCRE2_UCHAR buffer[4024];
             pcre2_get_error_message(err_num, buffer, sizeof(buffer));
-            return jpcre2_utils::toString((PCRE2_UCHAR*)buffer)+"; error offset: "+jpcre2_utils::toString((int)error_offset);
+            return jpcre2_utils::toString((PCRE2_UCHAR*)buffer)+"; error offset: "+jpcre2_utils::toString((int)err_offset);
             
         }
     }
@@ -97,6 +144,56 @@ Dsclaimer:
     }
     
     
+    ///Compile contexts are built once per locale and shared by all compiles, pcre2_compile() only reads them.
+    ///Compiled code points to the character tables of its context, so contexts and tables are kept until exit.
+    struct LocaleContext{
+        pcre2_compile_context* ccontext;
+        const unsigned char* tables;        ///null for the "none" locale, PCRE2's built-in tables are used
+    };
+    
+    struct LocaleContexts{
+        std::mutex mtx;
+        std::map<jpcre2::String,LocaleContext> contexts;
+        
+        ~LocaleContexts(){
+            for(auto& e : contexts){
+                pcre2_compile_context_free(e.second.ccontext);
+                #if PCRE2_MAJOR>10 || PCRE2_MINOR>=34
+                pcre2_maketables_free(NULL,e.second.tables);
+                #else
+                std::free((void*)e.second.tables);      ///made with malloc() by pcre2_maketables(NULL)
+                #endif
+            }
+        }
+    };
+    
+    static const LocaleContext& localeContext(const jpcre2::String& loc){
+        static LocaleContexts cache;
+        std::lock_guard<std::mutex> lock(cache.mtx);
+        std::map<jpcre2::String,LocaleContext>::iterator it=cache.contexts.find(loc);
+        if(it!=cache.contexts.end()) return it->second;
+        
+        LocaleContext lc;
+        lc.ccontext=pcre2_compile_context_create(NULL);
+        lc.tables=nullptr;
+        if(loc!="none"){
+            ///pcre2_maketables() reads the current LC_CTYPE, which is put back afterwards
+            const char* cur=std::setlocale(LC_CTYPE,NULL);
+            jpcre2::String loc_old=cur?cur:"C";
+            std::setlocale(LC_CTYPE,loc.c_str());
+            lc.tables=pcre2_maketables(NULL);
+            std::setlocale(LC_CTYPE,loc_old.c_str());
+            pcre2_set_character_tables(lc.ccontext,lc.tables);
+        }
+        return cache.contexts[loc]=lc;
+    }
+    
+    
+    const unsigned char* jpcre2::Regex::characterTables() const{
+        return localeContext(mylocale).tables;
+    }
+    
+    
     void jpcre2::Regex :: compileRegex(const String& re,const String& mod, const String& loc,
                                     uint32_t opt_bits, uint32_t pcre2_opts){
         c_pattern=(PCRE2_SPTR)re.c_str();
@@ -111,44 +208,647 @@ Dsclaimer:
         ///Now add other PCRE2 options to the compile_opts
         compile_opts |= pcre2_opts;
     
+        ///Pooled match data blocks are sized for the previous pattern
+        md_pool.clear();
+        loaded_tables.reset();
+        jit_compiled=false;
+        jit_pending=false;
+        all_opts=0;
+        required_literal.clear();
+        prefilter_checked=0;
+        prefilter_rejected=0;
+        if(stats_shards) resetStats();
+        
+        ///An identical compile may already be in the process-wide cache (if it's on)
+        String cache_key;
+        if(RegexCache::getCapacity() && !user_allocator){
+            cache_key=RegexCache::makeKey(re,mod,loc,opt_bits,pcre2_opts);
+            if(RegexCache::lookup(cache_key,code_ptr,jit_compiled,error_number)){
+                code=code_ptr.get();
+                error_code=error_number;
+                error_offset=0;
+                readPatternInfo();
+                if(opt_jit_compile && !jit_compiled) current_warning_msg="JIT compilation failed! Is it supported?";
+                return;
+            }
+        }
+    
     /*************************************************************************
     * Now we are going to compile the regular expression pattern, and handle *
     * any errors that are detected.                                          *
     *************************************************************************/
     
-        pcre2_compile_context *ccontext = pcre2_compile_context_create(NULL);
-        
-        if(loc!="none"){
-            String loc_old;
-            loc_old=jpcre2_utils::toString(std::setlocale(LC_CTYPE,loc.c_str()));
-            const unsigned char *tables = pcre2_maketables(NULL);
-            pcre2_set_character_tables(ccontext, tables);
-            std::setlocale(LC_CTYPE,loc_old.c_str());
+        ///The shared context of the locale, or a private one with the same tables when there's a user
+        ///allocator: the compiled code keeps the memory functions of its context, so match data made
+        ///from it and pcre2_substitute() use the user allocator too
+        const LocaleContext& shared = localeContext(loc);
+        pcre2_compile_context *ccontext = shared.ccontext;
+        if(gcontext){
+            ccontext = pcre2_compile_context_create(gcontext);
+            if(shared.tables) pcre2_set_character_tables(ccontext, shared.tables);
         }
-    
-    
+        
         code = pcre2_compile(
             c_pattern,                    /* the pattern */
-            PCRE2_ZERO_TERMINATED,      /* indicates pattern is zero-terminated */
+            re.length(),                /* length of the pattern, it may contain zeros */
             compile_opts,               /* default options */
             &error_number,              /* for error number */
             &error_offset,              /* for error offset */
             ccontext);                  /* use compile context */
         
+        if(ccontext!=shared.ccontext) pcre2_compile_context_free(ccontext);
+        
         error_code=error_number;
         /* Compilation failed: print the error message and exit. */
     
         if (code == NULL){
             ///must not free regex memory, the only function has that right is the destroyer.
             ///freeRegexMemory();
+            code_ptr.reset();
+            name_table.clear();
+            name_count=0;
             throw(error_number);
         }
-        else if(opt_jit_compile){
+        
+        ///The previous code (if any) is released here, unless it's still in use by the cache or another Regex.
+        code_ptr.reset(code,pcre2_code_free);
+        readPatternInfo();
+        
+        if(opt_jit_compile){
             ///perform jit compilation:
             int jit_ret=pcre2_jit_compile(code, jit_opts);
             if(jit_ret!=0){
                 //{throw(JIT_COMPILE_ERROR);};      // Must not throw any exception here
                 current_warning_msg="JIT compilation failed! Is it supported?";
-            }  
+            }
+            else jit_compiled=true;
+        }
+        
+        if(!cache_key.empty()) RegexCache::insert(cache_key,code_ptr,jit_compiled,error_number);
+    }
+    
+    void jpcre2::Regex::lazyJit() const{
+        ///Matchers on other threads wait here until the JIT code is ready
+        std::lock_guard<std::mutex> lock(jit_mutex);
+        if(!jit_pending.load(std::memory_order_relaxed)) return;
+        jit_compiled = pcre2_jit_compile(code, jit_opts)==0;
+        jit_pending.store(false,std::memory_order_release);
+    }
+    
+    static void flushRun(jpcre2::String& run,jpcre2::String& best){
+        if(run.size()>best.size()) best=run;
+        run.clear();
+    }
+    
+    ///Removes the last character of a run, a quantifier follows it.
+    static void dropLast(jpcre2::String& run,bool utf){
+        if(utf) while(!run.empty() && ((unsigned char)run[run.size()-1] & 0xc0) == 0x80) run.erase(run.size()-1);
+        if(!run.empty()) run.erase(run.size()-1);
+    }
+    
+    ///Finds a literal that every match of a pattern contains, for Regex::prefilter().
+    ///Only runs of plain characters outside of groups and classes are used and anything
+    ///not understood gives up, so the literal may be missing but is never wrong.
+    ///returns the longest run found, empty if there is none.
+    static jpcre2::String requiredLiteral(const jpcre2::String& pat,uint32_t opts){
+        jpcre2::String best,run;
+        
+        if(opts & (PCRE2_CASELESS | PCRE2_EXTENDED | PCRE2_AUTO_CALLOUT | PCRE2_ALT_BSUX)) return best;
+        #ifdef PCRE2_EXTENDED_MORE
+        if(opts & PCRE2_EXTENDED_MORE) return best;
+        #endif
+        #ifdef PCRE2_LITERAL
+        if(opts & PCRE2_LITERAL) return pat;
+        #endif
+        
+        bool utf=(opts & PCRE2_UTF)!=0;
+        size_t n=pat.size();
+        int depth=0;
+        
+        for(size_t i=0;i<n;i++){
+            unsigned char c=pat[i];
+            
+            if(c=='\\'){
+                if(i+1>=n) return "";
+                unsigned char e=pat[++i];
+                if(e=='Q' || e=='E') return "";
+                if(!std::isalnum(e)){
+                    if(depth==0) run+=(char)e;          ///escaped punctuation is itself
+                    continue;
+                }
+                if(depth==0) flushRun(run,best);
+                ///Skip the argument of the escape: \\c takes any character, \\x{..}, \\k<..>, \\g'..' etc.
+                ///take a bracketed one, \\x41, \\pL, \\12 and \\g-1 take a few characters.
+                if(e=='c'){i++;continue;}
+                if(i+1<n && (pat[i+1]=='{' || pat[i+1]=='<' || pat[i+1]=='\'')){
+                    char close=pat[i+1]=='{'?'}':pat[i+1]=='<'?'>':'\'';
+                    size_t j=pat.find(close,i+2);
+                    if(j==jpcre2::String::npos) return "";
+                    i=j;
+                }
+                else if(e=='x'){
+                    for(int k=0;k<2 && i+1<n && std::isxdigit((unsigned char)pat[i+1]);k++) i++;
+                }
+                else if(e=='p' || e=='P') i++;
+                else if(e=='g' || std::isdigit(e)){
+                    if(e=='g' && i+1<n && (pat[i+1]=='-' || pat[i+1]=='+')) i++;
+                    while(i+1<n && std::isdigit((unsigned char)pat[i+1])) i++;
+                }
+                continue;
+            }
+            
+            if(c=='['){
+                size_t j=i+1;
+                if(j<n && pat[j]=='^') j++;
+                if(j<n && pat[j]==']') j++;
+                for(;j<n && pat[j]!=']';j++){
+                    if(pat[j]=='\\') j++;
+                    else if(pat[j]=='[' && j+1<n && pat[j+1]==':'){
+                        j=pat.find(":]",j+2);
+                        if(j==jpcre2::String::npos) return "";
+                        j++;
+                    }
+                }
+                if(j>=n) return "";
+                i=j;
+                if(depth==0) flushRun(run,best);
+                continue;
+            }
+            
+            ///Verbs such as (*ACCEPT) can end a match anywhere
+            if(c=='(' && i+1<n && pat[i+1]=='*') return "";
+            
+            if(depth>0){
+                if(c=='(') depth++;
+                else if(c==')') depth--;
+                continue;
+            }
+            
+            switch(c){
+                ///Options, assertions and the like may change what follows
+                case '(':   if(i+1<n && pat[i+1]=='?') return "";
+                            depth=1;
+                            flushRun(run,best);
+                            break;
+                case ')':
+                case '|':   return "";
+                case '{':   {
+                                size_t j=i+1;
+                                while(j<n && (std::isdigit((unsigned char)pat[j]) || pat[j]==',' || pat[j]==' ')) j++;
+                                if(j>=n || pat[j]!='}'){run+=(char)c;break;}  ///not a quantifier
+                                i=j;
+                            }
+                            dropLast(run,utf);
+                            flushRun(run,best);
+                            break;
+                case '*':
+                case '+':
+                case '?':   dropLast(run,utf);
+                            flushRun(run,best);
+                            break;
+                case '.':
+                case '^':
+                case '$':   flushRun(run,best);
+                            break;
+                default:    run+=(char)c;
+            }
+        }
+        flushRun(run,best);
+        return best;
+    }
+    
+    bool jpcre2::Regex::prefilter(PCRE2_SPTR subject,PCRE2_SIZE length,uint32_t options) const{
+        if(required_literal.empty()) return true;
+        ///A partial match needn't contain the literal
+        if(options & (PCRE2_PARTIAL_HARD | PCRE2_PARTIAL_SOFT)) return true;
+        ///An invalid UTF subject must still be reported as such
+        bool check_utf=(all_opts & PCRE2_UTF) && !(options & PCRE2_NO_UTF_CHECK);
+        #ifdef PCRE2_MATCH_INVALID_UTF
+        if(all_opts & PCRE2_MATCH_INVALID_UTF) check_utf=false;
+        #endif
+        if(check_utf) return true;
+        
+        prefilter_checked.fetch_add(1,std::memory_order_relaxed);
+        
+        ///glibc's memchr() and memmem() are vectorized (SSE2/AVX2)
+        const char* s=(const char*)subject;
+        const char* lit=required_literal.data();
+        size_t lit_len=required_literal.size();
+        bool found;
+        if(lit_len==1) found=std::memchr(s,lit[0],length)!=nullptr;
+        #if defined(__GLIBC__) || defined(__APPLE__) || defined(__FreeBSD__)
+        else found=memmem(s,length,lit,lit_len)!=nullptr;
+        #else
+        else found=std::search(s,s+length,lit,lit+lit_len)!=s+length;
+        #endif
+        
+        if(!found) prefilter_rejected.fetch_add(1,std::memory_order_relaxed);
+        return found;
+    }
+    
+    void jpcre2::Regex::readPatternInfo(){
+        uint32_t newline=0;
+        PCRE2_SPTR tabptr;
+        
+        (void)pcre2_pattern_info(code, PCRE2_INFO_ALLOPTIONS, &all_opts);
+        (void)pcre2_pattern_info(code, PCRE2_INFO_NEWLINE, &newline);
+        crlf_is_newline = newline == PCRE2_NEWLINE_ANY ||
+                          newline == PCRE2_NEWLINE_CRLF ||
+                          newline == PCRE2_NEWLINE_ANYCRLF;
+        
+        required_literal=requiredLiteral(pat_str,compile_opts | all_opts);
+        
+        name_table.clear();
+        name_count=0;
+        name_entry_size=0;
+        name_entries=nullptr;
+        (void)pcre2_pattern_info(code, PCRE2_INFO_NAMECOUNT, &name_count);
+        if(name_count<=0) return;
+        (void)pcre2_pattern_info(code, PCRE2_INFO_NAMETABLE, &name_entries);
+        (void)pcre2_pattern_info(code, PCRE2_INFO_NAMEENTRYSIZE, &name_entry_size);
+        
+        ///The table is already sorted by name.
+        ///In the 8-bit library the number is held in two bytes, most significant first.
+        name_table.reserve(name_count);
+        tabptr=name_entries;
+        for(int i=0;i<name_count;i++,tabptr+=name_entry_size){
+            name_table.push_back(std::make_pair(String((const char*)(tabptr+2)),(Uint)((tabptr[0] << 8) | tabptr[1])));
+        }
+    }
+    
+    
+    ///The PCRE2 default of a limit, for the ones that aren't set
+    static uint32_t defaultLimit(uint32_t what){
+        uint32_t value=0;
+        (void)pcre2_config(what,&value);
+        return value;
+    }
+    
+    void jpcre2::MatchLimits::prepare(pcre2_match_context*& mcontext,pcre2_general_context* gcontext){
+        error=0;
+        deadline = time_ns ? Regex::statsClock()+time_ns : 0;
+        if(!match && !depth && !heap){
+            ///A context made for the JIT stack or for earlier limits goes back to the defaults
+            if(!mcontext) return;
+        }
+        else if(!mcontext) mcontext=pcre2_match_context_create(gcontext);
+        if(!mcontext) return;
+        static const uint32_t default_match=defaultLimit(PCRE2_CONFIG_MATCHLIMIT);
+        pcre2_set_match_limit(mcontext,match?match:default_match);
+        #ifdef PCRE2_CONFIG_DEPTHLIMIT
+        static const uint32_t default_depth=defaultLimit(PCRE2_CONFIG_DEPTHLIMIT);
+        pcre2_set_depth_limit(mcontext,depth?depth:default_depth);
+        #else
+        static const uint32_t default_depth=defaultLimit(PCRE2_CONFIG_RECURSIONLIMIT);
+        pcre2_set_recursion_limit(mcontext,depth?depth:default_depth);
+        #endif
+        #ifdef PCRE2_CONFIG_HEAPLIMIT
+        static const uint32_t default_heap=defaultLimit(PCRE2_CONFIG_HEAPLIMIT);
+        pcre2_set_heap_limit(mcontext,heap?heap:default_heap);
+        #endif
+    }
+    
+    bool jpcre2::MatchLimits::expired(){
+        if(!deadline || Regex::statsClock()<deadline) return false;
+        error=ERROR::TIME_LIMIT;
+        return true;
+    }
+    
+    bool jpcre2::MatchLimits::hit(int rc){
+        if(!any()) return false;
+        if(error==ERROR::TIME_LIMIT) return true;
+        switch(rc){
+            case PCRE2_ERROR_MATCHLIMIT:
+            #ifdef PCRE2_ERROR_DEPTHLIMIT
+            case PCRE2_ERROR_DEPTHLIMIT:
+            #else
+            case PCRE2_ERROR_RECURSIONLIMIT:
+            #endif
+            #ifdef PCRE2_ERROR_HEAPLIMIT
+            case PCRE2_ERROR_HEAPLIMIT:
+            #endif
+                error=rc;
+                return true;
+            default: return false;
+        }
+    }
+    
+    
+    ///State of the process-wide compiled pattern cache.
+    ///Entries are kept in LRU order, most recently used first.
+    struct RegexCacheState{
+        
+        struct Entry{
+            jpcre2::String key;
+            std::shared_ptr<pcre2_code> code;
+            bool jit_compiled;
+            int error_number;
+        };
+        
+        typedef std::list<Entry> List;
+        
+        std::mutex mtx;
+        List lru;
+        std::unordered_map<jpcre2::String,List::iterator> index;
+        std::atomic<jpcre2::Uint> capacity;     ///changed under mtx, read without it by compiles
+        jpcre2::Uint hits,misses,evictions;
+        
+        RegexCacheState(){capacity=JPCRE2_CACHE_CAPACITY;hits=misses=evictions=0;}
+        
+        void evict(){
+            while(lru.size()>capacity){
+                index.erase(lru.back().key);
+                lru.pop_back();
+                evictions++;
+            }
+        }
+    };
+    
+    ///Function local static, so that it's constructed before any static Regex uses it
+    static RegexCacheState& cacheState(){
+        static RegexCacheState state;
+        return state;
+    }
+    
+    jpcre2::String jpcre2::RegexCache::makeKey(const String& re,const String& mod,const String& loc,
+                                                uint32_t opt_bits,uint32_t pcre2_opts){
+        String key;
+        key.reserve(re.size()+mod.size()+loc.size()+3+2*sizeof(uint32_t));
+        key.append(re).append(1,'\0').append(mod).append(1,'\0').append(loc).append(1,'\0');
+        key.append((const char*)&opt_bits,sizeof(opt_bits)).append((const char*)&pcre2_opts,sizeof(pcre2_opts));
+        return key;
+    }
+    
+    bool jpcre2::RegexCache::lookup(const String& key,std::shared_ptr<pcre2_code>& code,bool& jit_compiled,int& error_number){
+        RegexCacheState& st=cacheState();
+        std::lock_guard<std::mutex> lock(st.mtx);
+        std::unordered_map<String,RegexCacheState::List::iterator>::iterator it=st.index.find(key);
+        if(it==st.index.end()){st.misses++;return false;}
+        st.hits++;
+        st.lru.splice(st.lru.begin(),st.lru,it->second);
+        code=it->second->code;
+        jit_compiled=it->second->jit_compiled;
+        error_number=it->second->error_number;
+        return true;
+    }
+    
+    void jpcre2::RegexCache::insert(const String& key,const std::shared_ptr<pcre2_code>& code,bool jit_compiled,int error_number){
+        RegexCacheState& st=cacheState();
+        std::lock_guard<std::mutex> lock(st.mtx);
+        if(!st.capacity || st.index.count(key)) return;     ///disabled meanwhile, or another thread was faster
+        RegexCacheState::Entry entry={key,code,jit_compiled,error_number};
+        st.lru.push_front(entry);
+        st.index[key]=st.lru.begin();
+        st.evict();
+    }
+    
+    void jpcre2::RegexCache::setCapacity(Uint n){
+        RegexCacheState& st=cacheState();
+        std::lock_guard<std::mutex> lock(st.mtx);
+        st.capacity=n;
+        st.evict();
+    }
+    
+    jpcre2::Uint jpcre2::RegexCache::getCapacity(){
+        return cacheState().capacity.load(std::memory_order_relaxed);
+    }
+    
+    jpcre2::Uint jpcre2::RegexCache::size(){
+        RegexCacheState& st=cacheState();
+        std::lock_guard<std::mutex> lock(st.mtx);
+        return st.lru.size();
+    }
+    
+    jpcre2::Uint jpcre2::RegexCache::getHits(){
+        RegexCacheState& st=cacheState();
+        std::lock_guard<std::mutex> lock(st.mtx);
+        return st.hits;
+    }
+    
+    jpcre2::Uint jpcre2::RegexCache::getMisses(){
+        RegexCacheState& st=cacheState();
+        std::lock_guard<std::mutex> lock(st.mtx);
+        return st.misses;
+    }
+    
+    jpcre2::Uint jpcre2::RegexCache::getEvictions(){
+        RegexCacheState& st=cacheState();
+        std::lock_guard<std::mutex> lock(st.mtx);
+        return st.evictions;
+    }
+    
+    void jpcre2::RegexCache::clear(){
+        RegexCacheState& st=cacheState();
+        std::lock_guard<std::mutex> lock(st.mtx);
+        st.index.clear();
+        st.lru.clear();
+        st.hits=st.misses=st.evictions=0;
+    }
+    
+    
+    ///Shards of the match statistics of a Regex. Each thread adds to the shard of its index, so
+    ///threads don't contend for the counters unless more than STATS_SHARDS of them match at once.
+    ///A shard is padded to a whole number of cache lines, and the shards start on one.
+    static const int STATS_SHARDS=16;
+    static const int CACHE_LINE=64;
+    
+    struct jpcre2::Regex::StatsShard{
+        std::atomic<Uint> calls,hits,misses,bytes,jit,interpreted,nanoseconds;
+        std::atomic<Uint> histogram[MatchStats::BUCKETS];
+        char pad[CACHE_LINE-(7+MatchStats::BUCKETS)*sizeof(std::atomic<Uint>)%CACHE_LINE];
+    };
+    
+    ///new[] doesn't align to more than alignof(std::max_align_t) before C++17. The block is over-allocated,
+    ///and how far into it the aligned start is goes in the byte before that start.
+    static void* newCacheAligned(size_t size){
+        char* raw=new char[size+CACHE_LINE];
+        char* p=raw+CACHE_LINE-reinterpret_cast<uintptr_t>(raw)%CACHE_LINE;
+        p[-1]=(char)(p-raw);
+        return p;
+    }
+    
+    static void deleteCacheAligned(void* p){
+        char* start=static_cast<char*>(p);
+        delete[] (start-(unsigned char)start[-1]);
+    }
+    
+    static unsigned threadStatsShard(){
+        static std::atomic<unsigned> next(0);
+        static thread_local unsigned shard=next.fetch_add(1,std::memory_order_relaxed)%STATS_SHARDS;
+        return shard;
+    }
+    
+    ///Regex objects collecting statistics, for RegexStats
+    struct StatsRegistry{
+        std::mutex mtx;
+        std::vector<const jpcre2::Regex*> regexes;
+    };
+    
+    ///Never destroyed: a Regex with static storage may stop collecting (in its destructor)
+    ///after the registry would have been destroyed at exit.
+    static StatsRegistry& statsRegistry(){
+        static StatsRegistry* registry=new StatsRegistry;
+        return *registry;
+    }
+    
+    uint64_t jpcre2::Regex::statsClock(){
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    
+    void jpcre2::Regex::recordMatch(int rc,PCRE2_SIZE bytes,bool jit,uint64_t start_ns) const{
+        uint64_t ns=statsClock()-start_ns;
+        StatsShard& s=stats_shards[threadStatsShard()];
+        s.calls.fetch_add(1,std::memory_order_relaxed);
+        if(rc>=0) s.hits.fetch_add(1,std::memory_order_relaxed);
+        else if(rc==PCRE2_ERROR_NOMATCH || rc==PCRE2_ERROR_PARTIAL) s.misses.fetch_add(1,std::memory_order_relaxed);
+        s.bytes.fetch_add(bytes,std::memory_order_relaxed);
+        (jit?s.jit:s.interpreted).fetch_add(1,std::memory_order_relaxed);
+        s.nanoseconds.fetch_add(ns,std::memory_order_relaxed);
+        ///bucket: the number of bits of ns
+        int b=0;
+        while(ns && b<MatchStats::BUCKETS-1){ns>>=1;b++;}
+        s.histogram[b].fetch_add(1,std::memory_order_relaxed);
+    }
+    
+    jpcre2::Regex& jpcre2::Regex::collectStats(bool x){
+        if(x==(stats_shards!=nullptr)) return *this;
+        StatsRegistry& reg=statsRegistry();
+        std::lock_guard<std::mutex> lock(reg.mtx);
+        if(x){
+            static_assert(sizeof(StatsShard)%CACHE_LINE==0,"a StatsShard shares a cache line with the next one");
+            stats_shards=static_cast<StatsShard*>(newCacheAligned(STATS_SHARDS*sizeof(StatsShard)));
+            for(int i=0;i<STATS_SHARDS;i++) new(&stats_shards[i]) StatsShard();
+            reg.regexes.push_back(this);
+        }
+        else{
+            reg.regexes.erase(std::find(reg.regexes.begin(),reg.regexes.end(),this));
+            deleteCacheAligned(stats_shards);
+            stats_shards=nullptr;
+        }
+        return *this;
+    }
+    
+    jpcre2::MatchStats jpcre2::Regex::getStats() const{
+        MatchStats st;
+        st.pattern=pat_str;
+        st.modifier=modifier;
+        if(!stats_shards) return st;
+        for(int i=0;i<STATS_SHARDS;i++){
+            const StatsShard& s=stats_shards[i];
+            st.calls        += s.calls.load(std::memory_order_relaxed);
+            st.hits         += s.hits.load(std::memory_order_relaxed);
+            st.misses       += s.misses.load(std::memory_order_relaxed);
+            st.bytes        += s.bytes.load(std::memory_order_relaxed);
+            st.jit          += s.jit.load(std::memory_order_relaxed);
+            st.interpreted  += s.interpreted.load(std::memory_order_relaxed);
+            st.nanoseconds  += s.nanoseconds.load(std::memory_order_relaxed);
+            for(int b=0;b<MatchStats::BUCKETS;b++) st.histogram[b] += s.histogram[b].load(std::memory_order_relaxed);
+        }
+        return st;
+    }
+    
+    void jpcre2::Regex::resetStats(){
+        if(!stats_shards) return;
+        for(int i=0;i<STATS_SHARDS;i++){
+            StatsShard& s=stats_shards[i];
+            s.calls=0;s.hits=0;s.misses=0;s.bytes=0;s.jit=0;s.interpreted=0;s.nanoseconds=0;
+            for(int b=0;b<MatchStats::BUCKETS;b++) s.histogram[b]=0;
+        }
+    }
+    
+    void jpcre2::Regex::copyFrom(const Regex& x){
+        ///The JIT code of a loaded pattern is made before its code is shared
+        x.ensureJit();
+        freeRegexMemory();
+        pat_str=x.pat_str;
+        modifier=x.modifier;
+        mylocale=x.mylocale;
+        c_pattern=(PCRE2_SPTR)pat_str.c_str();
+        code_ptr=x.code_ptr;
+        loaded_tables=x.loaded_tables;
+        code=x.code;
+        error_number=x.error_number;
+        error_offset=x.error_offset;
+        compile_opts=x.compile_opts;
+        jit_opts=x.jit_opts;
+        jpcre2_compile_opts=x.jpcre2_compile_opts;
+        error_code=x.error_code;
+        jpcre2_error_offset=x.jpcre2_error_offset;
+        current_action=x.current_action;
+        current_warning_msg=x.current_warning_msg;
+        opt_jit_compile=x.opt_jit_compile;
+        jit_compiled=x.jit_compiled;
+        jit_pending=false;
+        all_opts=x.all_opts;
+        name_table=x.name_table;
+        name_entries=x.name_entries;
+        name_count=x.name_count;
+        name_entry_size=x.name_entry_size;
+        crlf_is_newline=x.crlf_is_newline;
+        required_literal=x.required_literal;
+        prefilter_checked=0;
+        prefilter_rejected=0;
+        allocator(x.user_allocator);
+        ///A copy counts its own matches
+        collectStats(x.stats_shards!=nullptr);
+        resetStats();
+    }
+    
+    void jpcre2::Regex::moveFrom(Regex& x){
+        copyFrom(x);
+        ///x gives up its code, its allocator and its statistics
+        x.freeRegexMemory();
+        x.name_table.clear();
+        x.name_entries=nullptr;
+        x.name_count=0;
+        x.required_literal.clear();
+        x.user_allocator=nullptr;
+        if(x.stats_shards){
+            collectStats(false);
+            StatsRegistry& reg=statsRegistry();
+            std::lock_guard<std::mutex> lock(reg.mtx);
+            *std::find(reg.regexes.begin(),reg.regexes.end(),&x)=this;
+            stats_shards=x.stats_shards;
+            x.stats_shards=nullptr;
+        }
+    }
+    
+    jpcre2::Uint jpcre2::MatchStats::percentile(double p) const{
+        if(!calls) return 0;
+        Uint total=0;
+        for(int b=0;b<BUCKETS;b++) total+=histogram[b];
+        Uint seen=0;
+        for(int b=0;b<BUCKETS;b++){
+            seen+=histogram[b];
+            if(seen*100.0>=p*total) return (Uint)1<<b;
+        }
+        return (Uint)1<<(BUCKETS-1);
+    }
+    
+    std::vector<jpcre2::MatchStats> jpcre2::RegexStats::snapshot(){
+        std::vector<MatchStats> all;
+        {
+            StatsRegistry& reg=statsRegistry();
+            std::lock_guard<std::mutex> lock(reg.mtx);
+            all.reserve(reg.regexes.size());
+            for(Uint i=0;i<reg.regexes.size();i++) all.push_back(reg.regexes[i]->getStats());
+        }
+        std::stable_sort(all.begin(),all.end(),[](const MatchStats& a,const MatchStats& b){return a.nanoseconds>b.nanoseconds;});
+        return all;
+    }
+    
+    void jpcre2::RegexStats::dump(std::ostream& out,Uint top){
+        std::vector<MatchStats> all=snapshot();
+        if(top && all.size()>top) all.resize(top);
+        out<<std::setw(12)<<"total us"<<std::setw(12)<<"calls"<<std::setw(12)<<"hits"<<std::setw(12)<<"misses"
+           <<std::setw(14)<<"bytes"<<std::setw(8)<<"jit %"<<std::setw(10)<<"p50 ns"<<std::setw(10)<<"p99 ns"<<"  pattern"<<std::endl;
+        for(Uint i=0;i<all.size();i++){
+            const MatchStats& st=all[i];
+            out<<std::setw(12)<<st.nanoseconds/1000<<std::setw(12)<<st.calls<<std::setw(12)<<st.hits<<std::setw(12)<<st.misses
+               <<std::setw(14)<<st.bytes<<std::setw(8)<<(st.calls?st.jit*100/st.calls:0)
+               <<std::setw(10)<<st.percentile(50)<<std::setw(10)<<st.percentile(99)<<"  "<<st.pattern;
+            if(!st.modifier.empty()) out<<" ("<<st.modifier<<")";
+            out<<std::endl;
         }
     }
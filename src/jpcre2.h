@@ -57,22 +57,45 @@ Dsclaimer:
 
 #include <string>
 #include <cstring>
+#include <cctype>
+#include <cstdlib>
+#include <clocale>
 #include <sstream>
 #include <limits>
 #include <vector>
 #include <map>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <mutex>
+#include <list>
+#include <unordered_map>
+#include <deque>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <iterator>
+#include <chrono>
+#include <iomanip>
 
 
 namespace jpcre2{
     
     ///Errors // JPCRE2 error codes are positive numbers while PCRE2 error codes are negative numbers
     namespace ERROR {
-    enum { INVALID_MODIFIER                 = 2 };
+    enum { INVALID_MODIFIER                 = 2,
+           FILE_ERROR                       = 3,        ///A file couldn't be opened, mapped or written, see errno
+           TIME_LIMIT                       = 4 };      ///The time limit of a match or replace ran out
     }
     
     #define REGEX_STRING_MAX std::numeric_limits<int>::max() //This limits the maximum length of string that can be handled by default.
                                                              //This limit may or may not be used.
     #define DEFAULT_LOCALE "none"   ///We won't do anything about locale if it is set to "none" 
+    #ifndef JPCRE2_CACHE_CAPACITY
+    #define JPCRE2_CACHE_CAPACITY 0     ///Default number of compiled patterns kept by RegexCache, 0 (off) until setCapacity()
+    #endif
     
     ///Option bits. These are the options for JPCRE2.
     enum {  NONE                                = 0x0000000u,
@@ -94,107 +117,619 @@ namespace jpcre2{
     typedef std::vector<MapNtN> VecNtN;               //Vector of MapNtN
     typedef std::vector<MapNum> VecNum;               //Vector of MapNum
     
+    ///A captured group as an offset and a length into the subject. Unlike MapNum/MapNas, no copy of the substring
+    ///is made, the span stays meaningful as long as the subject it was matched against is alive.
+    struct Span{
+        PCRE2_SIZE start;       ///PCRE2_UNSET if the group did not participate in the match
+        PCRE2_SIZE length;
+        
+        bool isSet() const                              {return start!=PCRE2_UNSET;}
+        String str(const String& subject) const         {return isSet()?subject.substr(start,length):String();}
+    };
+    
+    typedef std::vector<Span> SpanNum;            //Spans of all groups of a match in one flat array, indexed by group number
+    typedef std::vector<SpanNum> VecSpan;             //Vector of SpanNum
+    
+    typedef std::vector<std::pair<String,Uint> > NameTable;   //Name to number table of a pattern, sorted by name.
+                                                              //Duplicate names (J modifier) have adjacent entries.
+    
     
     ///declare classes
+    class Allocator;
+    class MatchDataPool;
+    class RegexCache;
+    class MatchSet;
+    class MatchView;
+    class MatchRange;
     class Regex;
     class RegexMatch;
     class RegexReplace;
+    class RegexSet;
+    class RegexArchive;
     
     
     ///define classes
     
+    ///A user supplied source of memory, e.g an arena that is freed at once at the end of a request.
+    ///A Regex given one (Regex::allocator()) takes from it the memory of its compiled pattern, match data
+    ///blocks, backtracking frames and match contexts. JIT code is an exception, PCRE2 maps it itself.
+    ///MatchSet results can use it too. It must outlive everything allocated from it,
+    ///and be thread safe if used by more than one thread.
+    class Allocator{
+        public:
+            virtual ~Allocator(){}
+            virtual void* allocate(Uint size)=0;        ///null if out of memory
+            virtual void deallocate(void* p)=0;         ///may do nothing, as arenas do
+    };
+    
+    ///STL allocator taking memory from an Allocator, or from operator new if it's null
+    template<class T> class StlAllocator{
+        
+        private:
+        
+            Allocator* alloc;
+            
+            template<class U> friend class StlAllocator;
+            
+        public:
+            typedef T value_type;
+            
+            StlAllocator(Allocator* a=nullptr)                          {alloc=a;}
+            template<class U> StlAllocator(const StlAllocator<U>& x)    {alloc=x.alloc;}
+            
+            Allocator* getAllocator() const                             {return alloc;}
+            
+            T* allocate(std::size_t n){
+                void* p=alloc?alloc->allocate(n*sizeof(T)) : ::operator new(n*sizeof(T));
+                if(!p) throw std::bad_alloc();
+                return static_cast<T*>(p);
+            }
+            void deallocate(T* p,std::size_t){
+                if(alloc) alloc->deallocate(p);
+                else ::operator delete(p);
+            }
+            
+            template<class U> bool operator==(const StlAllocator<U>& x) const  {return alloc==x.alloc;}
+            template<class U> bool operator!=(const StlAllocator<U>& x) const  {return alloc!=x.alloc;}
+            
+            ///C++11 standard libraries that don't fill these in from allocator_traits
+            template<class U> struct rebind {typedef StlAllocator<U> other;};
+    };
+    
+    ///Limits against runaway (e.g catastrophically backtracking) matches, see RegexMatch::matchLimit()
+    struct MatchLimits{
+        uint32_t match,depth,heap;      ///0 for the PCRE2 defaults
+        uint64_t time_ns;               ///0 for none
+        uint64_t deadline;              ///end of the time limit of the current execute(), 0 for none
+        int error;                      ///the limit that stopped the last execute(), 0 if none
+        
+        MatchLimits(){clear();}
+        void clear(){match=depth=heap=0;time_ns=deadline=0;error=0;}
+        bool any() const {return match||depth||heap||time_ns;}
+        
+        ///Once per execute(): applies the limits to mcontext (created from gcontext if needed) and starts the time limit
+        void prepare(pcre2_match_context*& mcontext,pcre2_general_context* gcontext);
+        ///true if the time limit ran out
+        bool expired();
+        ///true if limits are set and rc is a limit error, which is kept in error
+        bool hit(int rc);
+    };
+    
+    ///A small lock-free pool of match data blocks, owned by a Regex.
+    ///Blocks are sized for the capture count of the compiled pattern,
+    ///thus the pool must be cleared whenever the pattern is recompiled.
+    ///A pool made with a number of pairs has blocks of that size instead, whatever the pattern.
+    class MatchDataPool{
+        
+        private:
+        
+            enum { SLOTS = 8 };         ///Number of blocks kept for reuse, extra blocks are freed on checkin
+            
+            std::atomic<pcre2_match_data*> slots[SLOTS];
+            uint32_t pairs;             ///ovector pairs of a new block, 0 to size it for the pattern
+            
+            void init(){for(int i=0;i<SLOTS;i++) slots[i].store(nullptr,std::memory_order_relaxed);}
+            
+        public:
+            explicit MatchDataPool(uint32_t n=0){init();pairs=n;}
+            MatchDataPool(const MatchDataPool& x){init();pairs=x.pairs;}      ///Pooled blocks are never shared between two pools
+            MatchDataPool& operator=(const MatchDataPool&){clear(); return *this;}
+            ~MatchDataPool(){clear();}
+            
+            ///Takes a block out of the pool, creates a new one for the pattern if the pool is empty.
+            ///Blocks sized for the pattern take memory the way the pattern did, others from gcontext.
+            pcre2_match_data* checkout(const pcre2_code* code,pcre2_general_context* gcontext=nullptr);
+            ///Puts a block back into the pool, frees it if the pool is full
+            void checkin(pcre2_match_data* match_data);
+            ///Frees all pooled blocks
+            void clear();
+    };
+    
+    
+    ///Process-wide LRU cache of compiled patterns, keyed by pattern, modifiers, locale and options.
+    ///Compiling a Regex that is already in the cache shares its compiled (and JIT compiled) code instead
+    ///of compiling it again. Compiled code is reference counted, evicting an entry never affects a Regex using it.
+    ///It's off unless setCapacity() (or JPCRE2_CACHE_CAPACITY) turns it on, as cached patterns stay
+    ///in memory until they are evicted. All functions are thread safe.
+    class RegexCache{
+        
+        private:
+        
+            static String makeKey(const String& re,const String& mod,const String& loc,uint32_t opt_bits,uint32_t pcre2_opts);
+            static bool lookup(const String& key,std::shared_ptr<pcre2_code>& code,bool& jit_compiled,int& error_number);
+            static void insert(const String& key,const std::shared_ptr<pcre2_code>& code,bool jit_compiled,int error_number);
+            
+            ///define buddies for RegexCache
+            friend class Regex;
+            
+        public:
+            static void setCapacity(Uint n);        ///0 disables the cache. Evicts entries if needed.
+            static Uint getCapacity();              ///Doesn't lock, compiling checks it every time
+            static Uint size();                     ///Number of cached patterns
+            static Uint getHits();
+            static Uint getMisses();
+            static Uint getEvictions();
+            static void clear();                    ///Drops all entries and resets the counters
+    };
+
+
+    ///Match statistics of a Regex, see Regex::collectStats().
+    ///A call is one match attempt: a findAll() makes one per match and one more that finds none,
+    ///a replace by pcre2_substitute() makes one for all of its matches.
+    struct MatchStats{
+        static const int BUCKETS=32;
+
+        String pattern,modifier;
+        Uint calls;
+        Uint hits,misses;           ///calls that matched / didn't, errors count as neither
+        Uint bytes;                 ///subject bytes scanned, from the start offset to the end of the match (of the subject for a miss)
+        Uint jit,interpreted;       ///calls run on JIT code / by the interpreter
+        Uint nanoseconds;           ///time spent in all calls
+        Uint histogram[BUCKETS];    ///histogram[i] counts the calls that took less than 2^i ns and at least 2^(i-1) ns,
+                                    ///the last bucket counts all longer calls too
+
+        MatchStats(){calls=hits=misses=bytes=jit=interpreted=nanoseconds=0;for(int i=0;i<BUCKETS;i++) histogram[i]=0;}
+
+        ///Upper bound (in ns, a power of 2) of the time taken by p percent of the calls
+        Uint percentile(double p) const;
+    };
+
+    ///Registry of all Regex objects collecting statistics, to find the most expensive patterns.
+    ///All functions are thread safe.
+    class RegexStats{
+        public:
+            ///Statistics of every Regex collecting them, most time spent first
+            static std::vector<MatchStats> snapshot();
+            ///Prints a table of snapshot(), top rows only if top isn't 0
+            static void dump(std::ostream& out,Uint top=0);
+    };
+
+
+    ///Holds all matches of a match operation in one structure-of-arrays buffer:
+    ///start and end offsets of all groups of all matches, and the number of groups set for each match.
+    ///The offsets of group g of match m are at index m*groups()+g.
+    ///Names are resolved through the name table of the pattern, which is shared, not copied.
+    ///Clearing does not release memory, so a MatchSet reused across execute() calls stops allocating
+    ///once it has grown big enough (or has been reserve()d).
+    class MatchSet{
+        
+        private:
+        
+            std::vector<PCRE2_SIZE,StlAllocator<PCRE2_SIZE> > m_start, m_end;   ///Group offsets, groups() entries per match
+            std::vector<uint32_t,StlAllocator<uint32_t> > m_rc;                 ///Highest set group number + 1, one entry per match
+            Uint m_groups;                              ///Number of groups per match (capture count + 1)
+            const NameTable* m_names;                   ///Name table of the pattern, owned by the Regex
+            
+            void init(Uint groups,const NameTable* names){clear();m_groups=groups;m_names=names;}
+            void push(const PCRE2_SIZE* ovector,uint32_t rc);
+            
+            ///define buddies for MatchSet
+            friend class RegexMatch;
+            
+        public:
+            ///The offsets are stored in memory from alloc if it isn't null
+            explicit MatchSet(Allocator* alloc=nullptr)
+                     :m_start(StlAllocator<PCRE2_SIZE>(alloc)),m_end(StlAllocator<PCRE2_SIZE>(alloc)),
+                      m_rc(StlAllocator<uint32_t>(alloc)){m_groups=0;m_names=nullptr;}
+            
+            void reserve(Uint matches,Uint groups)      {m_start.reserve(matches*groups);m_end.reserve(matches*groups);
+                                                         m_rc.reserve(matches);}
+            void clear()                                {m_start.clear();m_end.clear();m_rc.clear();}
+            
+            Uint size() const                           {return m_rc.size();}       ///Number of matches
+            Uint groups() const                         {return m_groups;}
+            
+            uint32_t setCount(Uint m) const             {return m_rc[m];}
+            bool isSet(Uint m,Uint g) const             {return m_start[m*m_groups+g]!=PCRE2_UNSET;}
+            PCRE2_SIZE start(Uint m,Uint g) const       {return m_start[m*m_groups+g];}
+            PCRE2_SIZE end(Uint m,Uint g) const         {return m_end[m*m_groups+g];}
+            PCRE2_SIZE length(Uint m,Uint g) const      {return isSet(m,g) && end(m,g)>start(m,g) ? end(m,g)-start(m,g) : 0;}
+            Span span(Uint m,Uint g) const              {Span sp={start(m,g),length(m,g)}; return sp;}
+            String str(const String& subject,Uint m,Uint g) const {return isSet(m,g)?subject.substr(start(m,g),length(m,g)):String();}
+            
+            ///Returns the group number for name in match m, the first set one if the name is duplicated.
+            ///Returns -1 if the pattern has no such name.
+            int number(const String& name,Uint m) const;
+    };
+    
+    
+    ///A single match, handed to callbacks as it is found. It points into the subject and the match data,
+    ///so it's only valid until the callback returns. Use str() to keep a substring.
+    ///Offsets are from the start of the subject (of the whole input when streaming).
+    class MatchView{
+        
+        private:
+        
+            const char* m_subject;              ///Offsets in m_ovector are relative to this
+            PCRE2_SIZE m_offset;                ///Added to the offsets of m_ovector
+            const PCRE2_SIZE* m_ovector;
+            Uint m_groups;                      ///Number of ovector pairs (capture count + 1)
+            const NameTable* m_names;
+            
+            MatchView(const char* subject,PCRE2_SIZE offset,const PCRE2_SIZE* ovector,Uint groups,const NameTable* names)
+                     {m_subject=subject;m_offset=offset;m_ovector=ovector;m_groups=groups;m_names=names;}
+            
+            ///define buddies for MatchView
+            friend class RegexMatch;
+            friend class RegexReplace;
+            friend class MatchRange;
+            
+        public:
+            Uint groups() const                     {return m_groups;}
+            bool isSet(Uint g) const                {return g<m_groups && m_ovector[2*g]!=PCRE2_UNSET;}
+            PCRE2_SIZE start(Uint g=0) const        {return isSet(g)?m_ovector[2*g]+m_offset:PCRE2_UNSET;}
+            PCRE2_SIZE end(Uint g=0) const          {return isSet(g)?m_ovector[2*g+1]+m_offset:PCRE2_UNSET;}
+            PCRE2_SIZE length(Uint g=0) const       {return isSet(g) && m_ovector[2*g+1]>m_ovector[2*g] ?
+                                                            m_ovector[2*g+1]-m_ovector[2*g] : 0;}
+            ///Points to the substring of group g in the subject, not zero terminated. Null if unset.
+            const char* data(Uint g=0) const        {return isSet(g)?m_subject+m_ovector[2*g]:nullptr;}
+            String str(Uint g=0) const              {return isSet(g)?String(data(g),length(g)):String();}
+            
+            ///Returns the group number for name, the first set one if the name is duplicated.
+            ///Returns -1 if the pattern has no such name.
+            int number(const String& name) const;
+            String str(const String& name) const    {int n=number(name); return n<0?String():str((Uint)n);}
+    };
+    
+    ///Called for each match, return false to stop matching
+    typedef std::function<bool(const MatchView&)> MatchCallback;
+    
+    ///Fills buffer with up to size bytes of input, returns how many. 0 means end of input.
+    typedef std::function<Uint(char* buffer,Uint size)> StreamReader;
+    
+    ///Takes the output of a replace piece by piece, in order
+    typedef std::function<void(const char* data,Uint size)> ReplaceSink;
+    
+    ///Returns the replacement for a match
+    typedef std::function<String(const MatchView&)> MatchEvaluator;
+    
+    
+    ///A RegexMatch only reads the compiled pattern of its Regex, all per call state lives in the RegexMatch itself.
+    ///Any number of threads can match against the same (already compiled) Regex concurrently
+    ///as long as each of them uses its own RegexMatch object, e.g jpcre2::RegexMatch rm(re);
+    ///The RegexMatch returned by Regex::match() is shared by all callers of that Regex and isn't thread safe.
     class RegexMatch{
         
         private: 
         
-            Regex* re;    ///We will use this to access private members in Regex
+            const Regex* re;    ///We will use this to access private members in Regex
+            Regex* err_re;      ///Errors are mirrored to this Regex, set only by Regex::match()
             
             String m_subject,m_modifier;
+            const char* p_subject;          ///Subject not owned by us (see subject(const char*,Uint)), null to use m_subject
+            PCRE2_SIZE p_subject_len;
             uint32_t match_opts,jpcre2_match_opts;
+            int error_code,jpcre2_error_offset;
+            PCRE2_SIZE error_offset;
+            String current_warning_msg;
+            
+            ///JIT stack of the calling thread is assigned to this context when jitStack() was set,
+            ///and the limits when any is set
+            pcre2_match_context* mcontext;
+            PCRE2_SIZE jit_stack_start,jit_stack_max;
+            MatchLimits limits;
+            
+            Uint chunk_size;            ///bytes read at a time by executeStream()
+            
+            ///The pattern of re compiled with PCRE2_USE_OFFSET_LIMIT, whose code is run instead
+            ///by scanRange(). Set only by Regex::matchParallel() and Regex::replaceParallel().
+            const Regex* range_re;
             
             ///vectors to contain the matches and maps of associated substrings
             VecNum* p_vec_num;
             VecNas* p_vec_nas;
             VecNtN* p_vec_ntn;
+            VecSpan* p_vec_span;
+            MatchSet* p_match_set;
             
             void parseMatchOpts(const String& mod);
-            void getNumberedSubstrings(int rc, pcre2_match_data *match_data,MapNum& num_map0);
-            void getNamedSubstrings(int namecount,int name_entry_size,PCRE2_SPTR tabptr, pcre2_match_data *match_data,
+            void getNumberedSubstrings(int rc, PCRE2_SPTR subject, PCRE2_SIZE* ovector,MapNum& num_map0);
+            void getNamedSubstrings(int namecount,int name_entry_size,PCRE2_SPTR tabptr, PCRE2_SPTR subject, PCRE2_SIZE* ovector,
                                                                                      MapNas& nas_map0, MapNtN& nn_map0);
+            void getSpans(pcre2_match_data *match_data,SpanNum& span_num0);
+            void setError(int err_code,PCRE2_SIZE err_offset);
+            void setModifierError(int c);
+            void setFileError(int errnum);
+            void prepareJit();
+            ///true if matching must stop at rc because a limit was hit, the error is set then
+            bool stopAtLimit(int rc);
+            
+            ///Runs a single match. Uses pcre2_jit_match() directly when the pattern is JIT compiled
+            ///and the options allow it, pcre2_match() otherwise.
+            int exec(PCRE2_SPTR subject,PCRE2_SIZE length,PCRE2_SIZE start_offset,uint32_t options,pcre2_match_data* match_data);
                                                                                      
-            ///returns the number of matches, stores the match results in the specified vectors
-            Uint match(const std::string& s,VecNum& vec_num,VecNas& vec_nas,VecNtN& vec_nn,
-                                            const std::string& mod,uint32_t opt_bits,uint32_t pcre2_opts);
+            ///Clears the result vectors and sets up the options and the JIT stack, once per execute()
+            void prepare(const std::string& mod,uint32_t opt_bits,uint32_t pcre2_opts);
+            
+            ///Matches one subject with a match data block of the pattern and appends the results
+            ///to the result vectors. Null vectors are skipped, no substring is extracted if all of them are null.
+            ///returns the number of matches.
+            Uint scan(PCRE2_SPTR subject,PCRE2_SIZE subject_length,pcre2_match_data* match_data);
+            
+            ///returns the number of matches, stores the match results in the specified vectors.
+            Uint match(PCRE2_SPTR subject,PCRE2_SIZE subject_length,const std::string& mod,uint32_t opt_bits,uint32_t pcre2_opts);
+            ///The loop of scan() on a block of one ovector pair, without extracting anything.
+            ///Stops at the first match unless all is set. returns the number of matches.
+            Uint countMatches(bool all);
+            
+            ///The global match loop over the matches that start in [start,end) of subject, for the pieces of
+            ///Regex::matchParallel() (jpcre2_parallel.cpp). The whole subject is searched, so ^, \b and
+            ///lookarounds see past both ends of the range, and the subject must have been checked for valid UTF.
+            ///Each match goes to on_match with the return code of its pcre2_match(), and on_match can stop
+            ///the loop by returning false. returns the number of matches.
+            Uint scanRange(PCRE2_SPTR subject,PCRE2_SIZE length,PCRE2_SIZE start,PCRE2_SIZE end,
+                           const std::function<bool(int,pcre2_match_data*)>& on_match);
                                             
-            void init(String s=""){p_vec_num=nullptr;p_vec_nas=nullptr;p_vec_ntn=nullptr;
-                                    m_subject=s;m_modifier="";match_opts=0;jpcre2_match_opts=NONE;}
+            void init(const String& s=""){p_vec_num=nullptr;p_vec_nas=nullptr;p_vec_ntn=nullptr;p_vec_span=nullptr;p_match_set=nullptr;
+                                    m_subject=s;p_subject=nullptr;p_subject_len=0;m_modifier="";match_opts=0;jpcre2_match_opts=NONE;
+                                    error_code=0;jpcre2_error_offset=0;error_offset=0;chunk_size=65536;limits.clear();
+                                    jit_stack_start=jit_stack_max=0;}
                             
-            RegexMatch(RegexMatch&){init();}
-            //~ RegexMatch& operator=(RegexMatch&){init(); return this;}
-            //~ RegexMatch& operator=(RegexMatch&,const String& s){init(s); return this;}
-            RegexMatch(const String& s){init(s);}
-            RegexMatch(){init();}
-            ~RegexMatch(){}
+            void initContext(){re=nullptr;err_re=nullptr;mcontext=nullptr;range_re=nullptr;}
+            
+            RegexMatch(RegexMatch&){init();initContext();}
+            RegexMatch& operator=(const RegexMatch&);
+            RegexMatch(){init();initContext();}
             
             
             ///define buddies for RegexMatch
             friend class Regex;
+            friend class MatchRange;
             
             
         public:
+            ///Creates a matcher of its own for a compiled Regex
+            explicit RegexMatch(const Regex& r)                         {init();initContext();re=&r;}
+            explicit RegexMatch(const Regex& r,const String& s)         {init(s);initContext();re=&r;}
+            ~RegexMatch(){if(mcontext) pcre2_match_context_free(mcontext);}
+            
+            ///Error handling
+            String getWarningMessage()                                  {return current_warning_msg;}
+            int getErrorCode()                                          {return error_code;}
+            String getErrorMessage(int err_num);
+            String getErrorMessage()                                    {return getErrorMessage(error_code);}
            
             ///Chained functions for taking parameters
             RegexMatch& numberedSubstringVector(VecNum& vec_num)       {p_vec_num=&vec_num;            return *this;}
             RegexMatch& namedSubstringVector(VecNas& vec_nas)          {p_vec_nas=&vec_nas;            return *this;}
             RegexMatch& nameToNumberMapVector(VecNtN& vec_ntn)         {p_vec_ntn=&vec_ntn;            return *this;}
-            RegexMatch& subject(const String& s)                               {m_subject=s;                   return *this;}
+            RegexMatch& numberedSpanVector(VecSpan& vec_span)          {p_vec_span=&vec_span;          return *this;}
+            RegexMatch& matchSet(MatchSet& match_set)                  {p_match_set=&match_set;        return *this;}
+            RegexMatch& subject(const String& s)                        {m_subject=s;p_subject=nullptr; return *this;}
+            
+            ///Subjects are binary safe, embedded zeros are part of the subject.
+            ///These two don't copy the subject, it must stay alive (and unchanged) until execute() returns.
+            RegexMatch& subject(const char* s,Uint len)                 {p_subject=s;p_subject_len=len; return *this;}
+            RegexMatch& subject(const String* s)                        {p_subject=s->data();
+                                                                         p_subject_len=s->size();       return *this;}
             RegexMatch& modifiers(const String& s)                             {m_modifier=s;                  return *this;}
             RegexMatch& jpcre2Options(uint32_t x=NONE)                  {jpcre2_match_opts=x;           return *this;}
             RegexMatch& pcre2Options(uint32_t x=NONE)                   {match_opts=x;                  return *this;}
             RegexMatch& findAll()                                       {jpcre2_match_opts |= FIND_ALL; return *this;}
             
+            ///Limits against runaway matches, 0 for the PCRE2 default (no time limit). Once any of them is set,
+            ///hitting one doesn't throw: execute() and the others return what was found before it,
+            ///limitReached() is true and getErrorCode() tells which limit it was (PCRE2_ERROR_MATCHLIMIT,
+            ///PCRE2_ERROR_DEPTHLIMIT, PCRE2_ERROR_HEAPLIMIT or ERROR::TIME_LIMIT).
+            ///The time limit is checked before each match attempt (each match of a findAll()), it can't stop
+            ///one that's running, the match limit bounds those. JIT code honours the match limit only.
+            RegexMatch& matchLimit(uint32_t x)                          {limits.match=x;                return *this;}
+            RegexMatch& depthLimit(uint32_t x)                          {limits.depth=x;                return *this;}
+            RegexMatch& heapLimit(uint32_t kibibytes)                   {limits.heap=kibibytes;         return *this;}
+            RegexMatch& timeLimit(Uint microseconds)                    {limits.time_ns=(uint64_t)microseconds*1000;
+                                                                                                        return *this;}
+            bool limitReached() const                                   {return limits.error!=0;}
+            
+            ///Runs JIT matches on a JIT stack of the calling thread, created on first use with startsize
+            ///and reused by all matchers on that thread. It is recreated if a bigger maxsize is asked for.
+            ///Without it, JIT uses 32K of machine stack which deep recursive patterns can exhaust.
+            ///Like the other settings, it's reset by Regex::match().
+            RegexMatch& jitStack(PCRE2_SIZE startsize,PCRE2_SIZE maxsize){jit_stack_start=startsize;
+                                                                          jit_stack_max=maxsize;     return *this;}
+            
             Uint execute(){
-                VecNum vec_num0;
-                VecNas vec_nas0;
-                VecNtN vec_ntn0;
-                
-                VecNum& vec_num = p_vec_num ? *p_vec_num : vec_num0;
-                VecNas& vec_nas = p_vec_nas ? *p_vec_nas : vec_nas0;
-                VecNtN& vec_ntn = p_vec_ntn ? *p_vec_ntn : vec_ntn0;
-                
-                return match(m_subject,vec_num,vec_nas,vec_ntn,m_modifier,jpcre2_match_opts,match_opts);               
+                PCRE2_SPTR s=(PCRE2_SPTR)(p_subject?p_subject:m_subject.data());
+                PCRE2_SIZE len=p_subject?p_subject_len:m_subject.size();
+                return match(s,len,m_modifier,jpcre2_match_opts,match_opts);
             }
+            
+            ///Matches each of n subjects in turn, the subject set with subject() is not used.
+            ///Modifiers, options and match data are set up once for the whole batch.
+            ///counts[i] becomes the number of matches in subjects[i] (0 for no match, at most 1 without findAll()).
+            ///The result vectors and the MatchSet get the matches of all subjects, in subject order,
+            ///so the matches of subjects[i] start at the sum of counts[0..i-1].
+            ///returns the total number of matches.
+            Uint executeBatch(const String* subjects,Uint n,std::vector<Uint>& counts);
+            Uint executeBatch(const std::vector<String>& subjects,std::vector<Uint>& counts){
+                return executeBatch(subjects.data(),(Uint)subjects.size(),counts);
+            }
+            
+            ///Matches an input too big to be held in memory, read chunkSize() bytes at a time (jpcre2_stream.cpp).
+            ///PCRE2_PARTIAL_HARD finds matches that cross the end of what has been read, those are completed
+            ///with the next chunk. Only the current chunk, the unfinished match and enough of the input
+            ///before them for lookbehinds are kept, so memory is bounded by the chunk size and the longest match.
+            ///Each match is passed to callback, which can stop the scan by returning false, the result vectors
+            ///are not filled. Without findAll() it stops after the first match. returns the number of matches.
+            Uint executeStream(const StreamReader& reader,const MatchCallback& callback);
+            Uint executeStream(std::istream& in,const MatchCallback& callback);
+            RegexMatch& chunkSize(Uint size)                            {chunk_size=size?size:1;       return *this;}
+            
+            ///Matches the file at path, mapped read-only for the call instead of read into a string
+            ///(jpcre2_stream.cpp). Spans and MatchSet offsets are file offsets.
+            ///Failing to open or map the file throws ERROR::FILE_ERROR.
+            Uint executeFile(const String& path);
+            
+            ///Tells whether the subject matches. Nothing is extracted and the result vectors are left alone;
+            ///a pooled block of one ovector pair is used, so repeated calls don't allocate.
+            bool test()                                                 {return countMatches(false)!=0;}
+            ///returns the number of matches, always all of them (as with findAll()). Nothing is extracted,
+            ///as with test().
+            Uint count()                                                {return countMatches(true);}
+            
+            ///Returns a range over the matches, each found only when the iteration gets to it:
+            ///for(const jpcre2::MatchView& m : rm.findAll().iterate()){...}
+            ///Stopping early skips the rest of the search, and no result vector is filled.
+            ///Without findAll() the range has the first match only. See MatchRange.
+            MatchRange iterate();
     };
     
     
+    ///A lazy range of the matches of a RegexMatch, made by RegexMatch::iterate().
+    ///It's a single pass (input) range: the next match is searched when the iterator is incremented,
+    ///which invalidates the MatchView of the previous one. The RegexMatch, its subject and the Regex
+    ///must stay alive and unchanged while the range is used. Match errors are thrown by begin() and ++.
+    class MatchRange{
+        
+        private:
+        
+            RegexMatch* rm;
+            const char* m_subject;
+            PCRE2_SIZE m_length;
+            pcre2_match_data* match_data;       ///Checked out of the pool of the Regex, for the life of the range
+            MatchView view;                     ///The current match
+            uint32_t options;
+            uint32_t retry_opts;                ///Options of the next search, set to find a non-empty match after an empty one
+            PCRE2_SIZE next_start;
+            bool global,started,more;
+            
+            MatchRange(RegexMatch* m,const char* subject,PCRE2_SIZE length);
+            MatchRange& operator=(const MatchRange&);
+            
+            ///Finds the next match, clears more if there's none
+            void advance();
+            
+            ///define buddies for MatchRange
+            friend class RegexMatch;
+            
+        public:
+        
+            class iterator{
+                private:
+                    MatchRange* r;              ///null at the end
+                    explicit iterator(MatchRange* p)                {r=p;}
+                    friend class MatchRange;
+                public:
+                    typedef std::input_iterator_tag iterator_category;
+                    typedef MatchView value_type;
+                    typedef std::ptrdiff_t difference_type;
+                    typedef const MatchView* pointer;
+                    typedef const MatchView& reference;
+                    
+                    iterator()                                      {r=nullptr;}
+                    reference operator*() const                     {return r->view;}
+                    pointer operator->() const                      {return &r->view;}
+                    iterator& operator++()                          {r->advance(); if(!r->more) r=nullptr; return *this;}
+                    bool operator==(const iterator& x) const        {return r==x.r;}
+                    bool operator!=(const iterator& x) const        {return r!=x.r;}
+            };
+            
+            MatchRange(MatchRange&& x);
+            ~MatchRange();
+            
+            iterator begin();
+            iterator end()                                          {return iterator(nullptr);}
+    };
+    
+    
+    ///Like RegexMatch, a RegexReplace of its own (jpcre2::RegexReplace rr(re);) can be used
+    ///concurrently with others on the same compiled Regex.
     class RegexReplace{
         
         private: 
         
-            Regex* re;    ///We will use this to access private members in Regex
+            const Regex* re;    ///We will use this to access private members in Regex
+            Regex* err_re;      ///Errors are mirrored to this Regex, set only by Regex::replace()
             
             String r_subject,r_modifier,r_replw;
+            MatchEvaluator r_evaluator;     ///Used instead of r_replw when set
+            const char* p_subject;          ///Subject not owned by us, null to use r_subject
+            PCRE2_SIZE p_subject_len;
             uint32_t replace_opts,jpcre2_replace_opts;
             PCRE2_SIZE buffer_size;
+            int error_code,jpcre2_error_offset;
+            PCRE2_SIZE error_offset;
+            pcre2_match_context* mcontext;  ///made when a limit is set
+            MatchLimits limits;
             
             
             void parseReplacementOpts(const String& mod);
+            void setError(int err_code,PCRE2_SIZE err_offset);
+            void setModifierError(int c);
+            void setFileError(int errnum);
+            
+            ///stores the replaced string in result after performing regex replace.
+            ///out_size is the initial size of the output buffer, 0 to estimate it from the input.
+            void replace(PCRE2_SPTR subject,PCRE2_SIZE subject_length,const String& repl,const String& mod,
+                                PCRE2_SIZE out_size,uint32_t opt_bits,uint32_t pcre2_opts,String& result);
+            
+            ///Walks the matches itself and passes the parts of the subject between them and the expanded
+            ///replacements to sink, in order, so the result is never held as a whole.
+            ///returns the number of replacements.
+            Uint replaceTo(PCRE2_SPTR subject,PCRE2_SIZE subject_length,const String& repl,const String& mod,
+                                uint32_t opt_bits,uint32_t pcre2_opts,const ReplaceSink& sink);
+            
+            ///One match attempt of walkMatches(), see RegexMatch::exec()
+            int exec(PCRE2_SPTR subject,PCRE2_SIZE length,PCRE2_SIZE start_offset,uint32_t options,pcre2_match_data* match_data);
             
-            ///returns a replaced string after performing regex replace
-            String replace( String mains, String repl,const String& mod,
-                                PCRE2_SIZE out_size,uint32_t opt_bits, uint32_t pcre2_opts);
+            ///The loop of replaceTo(): passes the subject between the matches to sink and calls replace_match
+            ///for each match, which passes its replacement to sink. The options must have been parsed already.
+            Uint walkMatches(PCRE2_SPTR subject,PCRE2_SIZE subject_length,const ReplaceSink& sink,
+                                const std::function<void(pcre2_match_data*)>& replace_match);
+            
+            #ifdef PCRE2_SUBSTITUTE_MATCHED
+            ///A piece of literal text of the replacement followed by the group it names, NO_GROUP for none
+            struct ReplacementPart{
+                static const uint32_t NO_GROUP=~(uint32_t)0;
+                PCRE2_SIZE start,length;
+                uint32_t group;
+            };
+            typedef std::vector<ReplacementPart> ReplacementParts;
+            
+            ///Splits repl into parts if it's made of literal text, $$, $n, ${n} and ${name} only
+            ///(without PCRE2_SUBSTITUTE_EXTENDED), for expandMatch() to copy the groups itself.
+            ///Leaves parts empty otherwise. The options must have been parsed already.
+            void splitReplacement(const String& repl,ReplacementParts& parts);
+            
+            ///Expands repl for the match in match_data into buffer, which is grown as needed and meant
+            ///to be reused from match to match. A replacement with parts (see splitReplacement()) whose
+            ///groups are all set is put together here, any other by pcre2_substitute(), which copies
+            ///the match data into a block of its own each time.
+            ///The options must have been parsed already. returns the length of the expansion.
+            PCRE2_SIZE expandMatch(PCRE2_SPTR subject,PCRE2_SIZE subject_length,pcre2_match_data* match_data,
+                                   const String& repl,const ReplacementParts& parts,String& buffer);
+            #endif
+            
+            ///replaceTo() with the result written to fd (jpcre2_stream.cpp)
+            Uint replaceToFd(PCRE2_SPTR subject,PCRE2_SIZE subject_length,int fd);
                                             
-            void init(const String& s=""){r_subject=s;r_modifier="";r_replw="";replace_opts=0;
-                                            jpcre2_replace_opts=NONE;buffer_size=REGEX_STRING_MAX;}
-            void init(const String& s,const String& repl){r_subject=s;r_modifier="";r_replw=repl;replace_opts=0;
-                                            jpcre2_replace_opts=NONE;buffer_size=REGEX_STRING_MAX;}
+            void init(const String& s="",const String& repl=""){r_subject=s;p_subject=nullptr;p_subject_len=0;
+                                            r_modifier="";r_replw=repl;r_evaluator=nullptr;replace_opts=0;
+                                            jpcre2_replace_opts=NONE;buffer_size=0;
+                                            error_code=0;jpcre2_error_offset=0;error_offset=0;limits.clear();}
                             
-            RegexReplace(RegexReplace&){init();}
-            //~ RegexMatch& operator=(RegexMatch&){init(); return this;}
-            //~ RegexMatch& operator=(RegexMatch&,const String& s){init(s); return this;}
-            RegexReplace(const String& s,const String& repl){init(s,repl);}
-            RegexReplace(const String& s=""){init(s);}
-            ~RegexReplace(){}
+            RegexReplace(RegexReplace&){init();re=nullptr;err_re=nullptr;mcontext=nullptr;}
+            RegexReplace& operator=(const RegexReplace&);
+            RegexReplace(){init();re=nullptr;err_re=nullptr;mcontext=nullptr;}
             
             
             ///define buddies for RegexReplace
@@ -202,20 +737,95 @@ namespace jpcre2{
             
             
         public:
+            ///Creates a replacer of its own for a compiled Regex
+            explicit RegexReplace(const Regex& r)                                       {init();re=&r;err_re=nullptr;mcontext=nullptr;}
+            explicit RegexReplace(const Regex& r,const String& s,const String& repl="") {init(s,repl);re=&r;err_re=nullptr;mcontext=nullptr;}
+            ~RegexReplace(){if(mcontext) pcre2_match_context_free(mcontext);}
+            
+            ///Error handling
+            int getErrorCode()                                          {return error_code;}
+            String getErrorMessage(int err_num);
+            String getErrorMessage()                                    {return getErrorMessage(error_code);}
            
             ///Chained functions for taking parameters
-            RegexReplace& subject(const String& s)                        {r_subject=s;                   return *this;}
+            RegexReplace& subject(const String& s)                        {r_subject=s;p_subject=nullptr; return *this;}
+            
+            ///Binary safe, no copy of the subject is made, see RegexMatch::subject(const char*,Uint)
+            RegexReplace& subject(const char* s,Uint len)                 {p_subject=s;p_subject_len=len; return *this;}
+            RegexReplace& subject(const String* s)                        {p_subject=s->data();
+                                                                           p_subject_len=s->size();       return *this;}
             RegexReplace& replaceWith(const String& s)                    {r_replw=s;                     return *this;}
+            RegexReplace& replaceWith(const char* s,Uint len)             {r_replw.assign(s,len);         return *this;}
+            
+            ///The replacement of each match is what f returns for it, instead of the replacement string.
+            ///The MatchView is valid only during the call. evaluator(nullptr) goes back to the replacement string.
+            RegexReplace& evaluator(const MatchEvaluator& f)              {r_evaluator=f;                 return *this;}
             RegexReplace& modifiers(const String& s)                      {r_modifier=s;                  return *this;}
             RegexReplace& jpcre2Options(uint32_t x=NONE)                  {jpcre2_replace_opts=x;         return *this;}
             RegexReplace& pcre2Options(uint32_t x=NONE)                   {replace_opts=x;                return *this;}
             RegexReplace& bufferSize(PCRE2_SIZE x)                        {buffer_size=x;                 return *this;}
             
+            ///Limits, see RegexMatch::matchLimit(). When one is hit, the result is the subject with the
+            ///matches found before it replaced, the rest is left as it is.
+            ///With a limit set the String result is built the way execute(const ReplaceSink&) does.
+            RegexReplace& matchLimit(uint32_t x)                          {limits.match=x;                return *this;}
+            RegexReplace& depthLimit(uint32_t x)                          {limits.depth=x;                return *this;}
+            RegexReplace& heapLimit(uint32_t kibibytes)                   {limits.heap=kibibytes;         return *this;}
+            RegexReplace& timeLimit(Uint microseconds)                    {limits.time_ns=(uint64_t)microseconds*1000;
+                                                                                                          return *this;}
+            bool limitReached() const                                     {return limits.error!=0;}
+            
             
             String execute(){
-                
-                return replace(r_subject,r_replw,r_modifier,buffer_size,jpcre2_replace_opts,replace_opts);          
+                String result;
+                execute(result);
+                return result;
+            }
+            
+            ///Stores the replaced string in result. The capacity of result is reused,
+            ///so replacing into the same string over and over stops allocating.
+            ///result may be the subject itself (subject(&s).execute(s)), a copy is made then.
+            void execute(String& result){
+                PCRE2_SPTR s=(PCRE2_SPTR)(p_subject?p_subject:r_subject.data());
+                PCRE2_SIZE len=p_subject?p_subject_len:r_subject.size();
+                if(p_subject && p_subject>=result.data() && p_subject<result.data()+result.size()){
+                    ///result would be overwritten while the subject is read from it
+                    String copy;
+                    execute(copy);
+                    result.swap(copy);
+                    return;
+                }
+                if(r_evaluator || limits.any()){
+                    ///One pass, straight into result
+                    result.clear();
+                    result.reserve(len);
+                    replaceTo(s,len,r_replw,r_modifier,jpcre2_replace_opts,replace_opts,
+                              [&result](const char* data,Uint size){result.append(data,size);});
+                }
+                else replace(s,len,r_replw,r_modifier,buffer_size,jpcre2_replace_opts,replace_opts,result);
+            }
+            
+            ///Passes the result to sink piece by piece (the parts of the subject between the matches
+            ///and the expanded replacements) as the matches are found, instead of building it.
+            ///Memory use doesn't grow with the size of the result. returns the number of replacements.
+            Uint execute(const ReplaceSink& sink){
+                PCRE2_SPTR s=(PCRE2_SPTR)(p_subject?p_subject:r_subject.data());
+                PCRE2_SIZE len=p_subject?p_subject_len:r_subject.size();
+                return replaceTo(s,len,r_replw,r_modifier,jpcre2_replace_opts,replace_opts,sink);
             }
+            
+            ///Writes the result to out as it goes, see execute(const ReplaceSink&).
+            ///Write errors are left in the state of out.
+            Uint execute(std::ostream& out);
+            
+            ///Writes the result to the file descriptor fd in 64K blocks as it goes.
+            ///A failed write throws ERROR::FILE_ERROR.
+            Uint executeFd(int fd);
+            
+            ///Replaces in the file at path, mapped read-only instead of read into a string, and writes
+            ///the result to the file descriptor fd as it goes (jpcre2_stream.cpp). returns the number of replacements.
+            ///Failing to open, map or write throws ERROR::FILE_ERROR.
+            Uint executeFile(const String& path,int fd);
     };
     
     
@@ -230,6 +840,10 @@ namespace jpcre2{
             String modifier;
             PCRE2_SPTR c_pattern;
             pcre2_code *code;
+            std::shared_ptr<pcre2_code> code_ptr;     ///owns code, shared with RegexCache and other Regex objects
+            ///Null unless the code was loaded by RegexArchive: then it stands for the copy of the character
+            ///tables pcre2_serialize_decode() made for its block, shared by the patterns of that block
+            std::shared_ptr<const void> loaded_tables;
             int error_number;
             PCRE2_SIZE error_offset;
             uint32_t compile_opts,jit_opts,jpcre2_compile_opts;
@@ -239,17 +853,71 @@ namespace jpcre2{
             
             ///other opts
             bool opt_jit_compile;
+            mutable bool jit_compiled;  ///JIT compilation was requested and succeeded
             
+            ///A pattern loaded by RegexArchive is JIT compiled by its first match, not by the load
+            mutable std::atomic<bool> jit_pending;
+            mutable std::mutex jit_mutex;
+            void ensureJit() const      {if(jit_pending.load(std::memory_order_acquire)) lazyJit();}
+            void lazyJit() const;
+            uint32_t all_opts;          ///PCRE2_INFO_ALLOPTIONS of the compiled pattern
             
+            ///memory of the pattern and its matches comes from user_allocator through gcontext, if set
+            Allocator* user_allocator;
+            pcre2_general_context* gcontext;
+            
+            ///match data blocks reused by RegexMatch, checked out concurrently by const matchers
+            mutable MatchDataPool md_pool;
+            mutable MatchDataPool md_pool_min{1};   ///Blocks of one ovector pair, for test() and count()
+            
+            ///name to number table, taken from the compiled pattern once per compile
+            NameTable name_table;
+            
+            ///pattern info used by every match, read once per compile
+            PCRE2_SPTR name_entries;    ///raw PCRE2_INFO_NAMETABLE, points into code
+            int name_count,name_entry_size;
+            bool crlf_is_newline;
+            
+            void readPatternInfo();
+            
+            ///The character tables the pattern was compiled with, null for PCRE2's built-in ones ("none" locale)
+            const unsigned char* characterTables() const;
+            
+            ///A literal every match contains. Subjects without it are rejected
+            ///before they get to PCRE2, counted by the prefilter counters.
+            String required_literal;
+            mutable std::atomic<Uint> prefilter_checked,prefilter_rejected;
+            
+            ///false if subject can't match with options, because it lacks the required literal
+            bool prefilter(PCRE2_SPTR subject,PCRE2_SIZE length,uint32_t options) const;
+
+            ///Match statistics, null unless collectStats() turned them on.
+            ///Counters are kept in shards picked by thread and summed by getStats().
+            struct StatsShard;
+            StatsShard* stats_shards;
+
+            static uint64_t statsClock();
+            ///Counts a match call that returned rc after starting at start_ns (a statsClock() value)
+            void recordMatch(int rc,PCRE2_SIZE bytes,bool jit,uint64_t start_ns) const;
+            
+            ///One match attempt with the code of code_re, this pattern or a copy of it compiled with more options,
+            ///counted in the stats of this one. JIT compiled code is run by pcre2_jit_match() when the options allow it.
+            ///Out of JIT stack, the match is run again by the interpreter and jit_fallback is set.
+            int exec(const Regex* code_re,PCRE2_SPTR subject,PCRE2_SIZE length,PCRE2_SIZE start_offset,uint32_t options,
+                     pcre2_match_data* match_data,pcre2_match_context* mcontext,bool& jit_fallback) const;
+
+
             // Warning msg 
             String current_warning_msg;
             
-            //~ ///Regex re=Regex(); and such are not allowed.
-            //~ Regex(const Regex&);
-            //~ void operator=(const Regex&);
+            ///A copy shares the compiled code of x and compiles nothing. A move takes it over,
+            ///leaving x without a compiled pattern.
+            void copyFrom(const Regex& x);
+            void moveFrom(Regex& x);
             
             ///We can't let user call this function explicitly
-            void freeRegexMemory(void){pcre2_code_free(code);}                 ///frees memory used for the compiled regex.
+            void freeRegexMemory(void){md_pool.clear();md_pool_min.clear();code_ptr.reset();loaded_tables.reset();code=nullptr;   ///frees memory used for the compiled regex.
+                                       if(gcontext){pcre2_general_context_free(gcontext);gcontext=nullptr;}}
             
             
             void parseCompileOpts(const String& mod,uint32_t opt_bits);
@@ -258,11 +926,20 @@ namespace jpcre2{
             
             
             void init(const String& re=""){ pat_str=re;modifier="";mylocale=DEFAULT_LOCALE;error_number=0;
-                                            error_offset=0;error_code=0;jpcre2_error_offset=0;compile_opts=0;
+                                            error_offset=0;error_code=0;jpcre2_error_offset=0;compile_opts=0;jpcre2_compile_opts=0;
+                                            jit_compiled=false;jit_pending=false;all_opts=0;
+                                            name_entries=nullptr;name_count=name_entry_size=0;crlf_is_newline=false;
+                                            prefilter_checked=0;prefilter_rejected=0;
+                                            user_allocator=nullptr;gcontext=nullptr;stats_shards=nullptr;
                                             compileRegex("","",DEFAULT_LOCALE,0,0);}
-            void init(const String& re, const String& mod){ pat_str=re;modifier=mod;mylocale=DEFAULT_LOCALE;error_number=0;
-                                                            error_offset=0;error_code=0;jpcre2_error_offset=0;compile_opts=0;
-                                                            compileRegex("","",DEFAULT_LOCALE,0,0);}  
+            void init(const String& re, const String& mod){ mylocale=DEFAULT_LOCALE;error_number=0;
+                                                            error_offset=0;error_code=0;jpcre2_error_offset=0;compile_opts=0;jpcre2_compile_opts=0;
+                                                            jit_compiled=false;jit_pending=false;all_opts=0;
+                                                            name_entries=nullptr;name_count=name_entry_size=0;crlf_is_newline=false;
+                                                            prefilter_checked=0;prefilter_rejected=0;
+                                                            user_allocator=nullptr;gcontext=nullptr;stats_shards=nullptr;
+                                                            compileRegex("","",DEFAULT_LOCALE,0,0);
+                                                            pat_str=re;modifier=mod;}  
                 ///init() must perform a dummy compile, otherwise it will yield to a 
                 /// segmentation fault when regex is not initialized and goes out of scope, due to a call of
                 ///freeRegexMemory() in the destructor.
@@ -270,24 +947,50 @@ namespace jpcre2{
             
             ///Compiles the regex.
             void compileRegex(const String& re,const String& mod,const String& loc,uint32_t opt_bits, uint32_t pcre2_opts);
+            
+            static String errorMessage(int err_num,int jpcre2_err_offset,PCRE2_SIZE err_offset);
                             
                             
             ///Define buddies for Regex
             friend class RegexMatch;
             friend class RegexReplace;
+            friend class RegexSet;
+            friend class MatchRange;
+            friend struct MatchLimits;
+            friend class RegexArchive;
             
         public:
-            Regex(const Regex&){init();}
+            Regex(const Regex& x){init();copyFrom(x);}
+            Regex(Regex&& x){init();moveFrom(x);}
             Regex(){init();}
             Regex(const String& re, const String& mod="")  {init(re,mod);}
             
-            ~Regex(){freeRegexMemory();}
+            ~Regex(){collectStats(false);freeRegexMemory();}
+            
+            Regex& operator=(const Regex& x)    {if(this!=&x) copyFrom(x);  return *this;}
+            Regex& operator=(Regex&& x)         {if(this!=&x) moveFrom(x);  return *this;}
             
                 
             String getModifier()        {return modifier;    }
             String getPattern()         {return pat_str;     }
             String getLocale()          {return mylocale;    }      ///Gets LC_CTYPE
             uint32_t getCompileOpts()   {return compile_opts;}      ///returns the compile opts used for compilation
+            bool isJitCompiled()        {return jit_compiled;}      ///true if matches can run on JIT code (after the first match for a loaded pattern)
+            const NameTable& getNameTable() {return name_table;}    ///returns the name to number table of the compiled pattern
+            
+            ///The prefilter looks for this literal before matching, empty if the pattern has none.
+            ///It isn't used for partial matches nor for UTF patterns unless the UTF check is off.
+            const String& getRequiredLiteral()  {return required_literal;}
+            Uint getPrefilterChecks()           {return prefilter_checked;}     ///subjects looked at by the prefilter
+            Uint getPrefilterRejects()          {return prefilter_rejected;}    ///subjects it found can't match
+            
+            ///Opt-in match statistics: calls, hits, misses, bytes scanned, JIT use and a latency histogram,
+            ///see MatchStats. They cost two clock reads per match call. A Regex collecting them is listed by
+            ///RegexStats. They are reset by compiling. Must not be switched while the Regex is matching.
+            Regex& collectStats(bool x=true);
+            bool isCollectingStats() const      {return stats_shards!=nullptr;}
+            MatchStats getStats() const;        ///sum of all threads, may be read while matching
+            void resetStats();
             
             
             ///Error handling
@@ -306,20 +1009,150 @@ namespace jpcre2{
             Regex& locale(const String& x)                      {mylocale=x;                return *this;}
             Regex& jpcre2Options(uint32_t x)                    {jpcre2_compile_opts=x;     return *this;}
             Regex& pcre2Options(uint32_t x)                     {compile_opts=x;            return *this;}
+            ///Takes the memory of the pattern and its matches from alloc, starting with the next execute().
+            ///Patterns compiled with an allocator bypass the RegexCache, as cached code may outlive it.
+            ///Null goes back to malloc().
+            Regex& allocator(Allocator* alloc);
             
             void execute(void){
                 compileRegex(pat_str,modifier,mylocale,jpcre2_compile_opts,compile_opts);
             }
             
             
-            ///This is the match() function that will be called by users
-            RegexMatch& match(String s=""){rm=RegexMatch(s);rm.re = this;return rm;}
+            ///This is the match() function that will be called by users.
+            ///It reuses a single RegexMatch owned by this Regex, thus it must not be called from
+            ///multiple threads at once. Create a RegexMatch of your own for that.
+            RegexMatch& match(const String& s=""){rm.init(s);rm.re=this;rm.err_re=this;return rm;}
+            
+            ///This is the replace function that will be called by users.
+            ///Not thread safe either, see match().
+            RegexReplace& replace() {rr.init();rr.re=this;rr.err_re=this;return rr;}
+            RegexReplace& replace(const String& mains) {rr.init(mains);rr.re=this;rr.err_re=this;return rr;}
+            RegexReplace& replace(const String& mains,const String& repl) {rr.init(mains,repl);rr.re=this;rr.err_re=this;return rr;}
+            
+            ///Parallel match and replace (jpcre2_parallel.cpp).
+            ///The work is split into tasks run by a pool of threads (threads=0 for one per core) that
+            ///steal tasks from each other when they run out. The threads are kept for the next call,
+            ///and less than 64K of subject in all is done on the calling thread. Results are always in subject order,
+            ///the same as a sequential run would give. Errors are thrown the same way as by execute().
+            ///The Regex must be compiled and must not be changed while these run.
+            
+            ///Matches a batch of subjects, counts[i] gets the number of matches in subjects[i].
+            ///vec_num and vec_span (if not null) get the matches of all subjects in order,
+            ///see RegexMatch::executeBatch(). returns the total number of matches.
+            Uint matchParallel(const std::vector<String>& subjects,std::vector<Uint>& counts,const String& mod="",
+                               VecNum* vec_num=nullptr,VecSpan* vec_span=nullptr,Uint threads=0) const;
+            
+            ///Matches one huge subject cut into pieces at line boundaries, matched at the same time. A piece is
+            ///searched within the whole subject, so ^, \A, \b and lookarounds see across the cuts, and a
+            ///search doesn't go past the end of its piece (the pattern is compiled again with PCRE2_USE_OFFSET_LIMIT).
+            ///A match that runs into the next piece has that piece matched again from where the match ends,
+            ///until it gets back to the matches found the first time. The matches are thus those of execute(),
+            ///but patterns that often match across lines gain little. \G matches at the start of each piece.
+            ///The subject isn't cut without the g modifier, with the A modifier, for an anchored pattern,
+            ///nor below 128K.
+            Uint matchParallel(const String& subject,const String& mod="",VecNum* vec_num=nullptr,
+                               VecSpan* vec_span=nullptr,Uint threads=0) const;
+            
+            ///Replaces in a batch of subjects, results[i] gets the result for subjects[i]
+            void replaceParallel(const std::vector<String>& subjects,std::vector<String>& results,const String& repl,
+                                 const String& mod="",Uint threads=0) const;
+            
+            ///Replaces in one huge subject cut at line boundaries, see matchParallel(const String&...).
+            ///The replacement of each match is expanded on its own, which needs PCRE2 10.38 or later;
+            ///with an older PCRE2 the subject isn't cut.
+            String replaceParallel(const String& subject,const String& repl,const String& mod="",Uint threads=0) const;
+            
+    };
+    
+    
+    ///A set of patterns matched against one subject together, reporting which of them match.
+    ///Each pattern is compiled on its own. A subject is scanned once for the bytes it contains, which
+    ///picks the candidates: the patterns whose required bytes (PCRE2_INFO_FIRSTCODEUNIT/LASTCODEUNIT,
+    ///FIRSTBITMAP, either case of a letter) are all present and whose minimum length fits. Each candidate
+    ///is then matched on its own, so it's the patterns that can't match a subject that cost next to nothing:
+    ///they are looked up by their required byte and never run.
+    ///match() only reads the set, any number of threads can match concurrently. add() must not
+    ///run concurrently with anything else.
+    class RegexSet{
+        
+        private:
+            
+            ///What a subject must have for a pattern to match
+            struct Filter{
+                PCRE2_SIZE min_length;
+                int unit[2],alt_unit[2];    ///required bytes (-1 for none), alt_unit is the other case
+                bool has_bitmap;            ///the first byte must be one of bitmap
+                uint64_t bitmap[4];
+            };
+            
+            std::vector<std::unique_ptr<Regex> > patterns;
+            std::vector<Filter> filters;
+            std::vector<Uint> buckets[256];     ///patterns by their first required byte
+            std::vector<Uint> unfiltered;       ///patterns without a required byte
+            
+            RegexSet(const RegexSet&);
+            RegexSet& operator=(const RegexSet&);
+            
+            void buildFilter(const Regex& re,Filter& f);
+            bool passes(const Filter& f,const uint64_t* present,PCRE2_SIZE len) const;
+            
+        public:
+            RegexSet(){}
+            
+            ///Compiles a pattern with compile modifiers (in the locale loc) and adds it to the set,
+            ///its index is size()-1. Compile errors are thrown like Regex::execute() does
+            ///and the pattern is not added.
+            RegexSet& add(const String& re,const String& mod="",const String& loc=DEFAULT_LOCALE);
+            
+            Uint size() const                               {return patterns.size();}
+            const Regex& pattern(Uint i) const              {return *patterns[i];}
+            void clear();
+            
+            ///Puts the indexes of the patterns matching subject in matched, in ascending order.
+            ///returns their count. Match errors are thrown like RegexMatch::execute() does.
+            Uint match(const char* subject,Uint len,std::vector<Uint>& matched) const;
+            Uint match(const String& subject,std::vector<Uint>& matched) const {
+                return match(subject.data(),subject.size(),matched);
+            }
+    };
+    
+    
+    ///Compiled patterns saved to a file and loaded back without compiling them again (jpcre2_stream.cpp),
+    ///e.g built at deploy time and loaded at startup. The compiled code is saved by pcre2_serialize_encode(),
+    ///one block per locale and per loaded block (a block holds the character tables once), along with the
+    ///pattern, modifiers, locale and options of each Regex. The file is mapped to load it. JIT code
+    ///(S modifier) can't be saved, a loaded pattern is JIT compiled by its first match.
+    ///A file can only be loaded by the PCRE2 version and byte order that saved it, or else
+    ///load() throws PCRE2_ERROR_BADMODE and the like.
+    class RegexArchive{
+        
+        private:
+            
+            std::vector<const Regex*> regexes;
+            int error_code,error_errno;
+            
+        public:
+            RegexArchive(){error_code=0;error_errno=0;}
+            
+            ///Adds a compiled Regex to be saved. It's kept by pointer, it must outlive save().
+            RegexArchive& add(const Regex& re)          {regexes.push_back(&re);        return *this;}
+            Uint size() const                           {return regexes.size();}
+            void clear()                                {regexes.clear();}
+            
+            ///Writes the added patterns to path. A Regex that isn't compiled throws PCRE2_ERROR_NULL,
+            ///failing to write throws ERROR::FILE_ERROR, encoding errors are thrown as they are.
+            void save(const String& path);
             
-            ///This is the replace function that will be called by users
-            RegexReplace& replace() {rr=RegexReplace();rr.re=this;return rr;}
-            RegexReplace& replace(const String& mains) {rr=RegexReplace(mains);rr.re=this;return rr;}
-            RegexReplace& replace(const String& mains,const String& repl) {rr=RegexReplace(mains,repl);rr.re=this;return rr;}
+            ///Appends the patterns saved in path to regexes, in the order they were added.
+            ///returns the number of patterns loaded. Failing to read throws ERROR::FILE_ERROR,
+            ///a file not written by save() throws PCRE2_ERROR_BADMAGIC or PCRE2_ERROR_BADSERIALIZEDDATA,
+            ///one saved on a machine of the other byte order throws PCRE2_ERROR_BADMODE.
+            Uint load(const String& path,std::vector<std::unique_ptr<Regex> >& regexes);
             
+            int getErrorCode()                          {return error_code;}
+            String getErrorMessage(int err_num);
+            String getErrorMessage()                    {return getErrorMessage(error_code);}
     };
     
 
@@ -332,7 +1165,11 @@ namespace jpcre2_utils{
     #define Glue(a,b) a##b 
     
     template<typename T>
-    jpcre2::String toString(T a);
+    jpcre2::String toString(T a){
+        std::stringstream ss;
+        ss <<a;
+        return ss.str();
+    }
 }
 
 
@@ -42,6 +42,112 @@ Dsclaimer:
 
 #include "jpcre2.h"
 
+    void jpcre2::RegexMatch::setError(int err_code,PCRE2_SIZE err_offset){
+        error_code=err_code;
+        error_offset=err_offset;
+        if(err_re){err_re->error_code=err_code;err_re->error_offset=err_offset;}
+    }
+    
+    void jpcre2::RegexMatch::setModifierError(int c){
+        error_code=jpcre2_error_offset=c;
+        if(err_re) err_re->error_code=err_re->jpcre2_error_offset=c;
+    }
+    
+    void jpcre2::RegexMatch::setFileError(int errnum){
+        error_code=ERROR::FILE_ERROR;
+        jpcre2_error_offset=errnum;
+        if(err_re){err_re->error_code=ERROR::FILE_ERROR;err_re->jpcre2_error_offset=errnum;}
+    }
+    
+    jpcre2::String jpcre2::RegexMatch::getErrorMessage(int err_num){
+        return Regex::errorMessage(err_num,jpcre2_error_offset,error_offset);
+    }
+    
+    ///Match options pcre2_jit_match() honours for code compiled with PCRE2_JIT_COMPLETE.
+    ///Any other option (e.g PCRE2_ANCHORED) needs pcre2_match().
+    static const uint32_t JIT_MATCH_OPTS = PCRE2_NOTBOL | PCRE2_NOTEOL | PCRE2_NOTEMPTY |
+                                           PCRE2_NOTEMPTY_ATSTART | PCRE2_NO_UTF_CHECK;
+    
+    ///A JIT stack for each thread, shared by all the matchers that run on it
+    struct ThreadJitStack{
+        pcre2_jit_stack* stack;
+        PCRE2_SIZE max_size;
+        
+        ThreadJitStack(){stack=nullptr;max_size=0;}
+        ~ThreadJitStack(){if(stack) pcre2_jit_stack_free(stack);}
+        
+        pcre2_jit_stack* get(PCRE2_SIZE startsize,PCRE2_SIZE maxsize){
+            if(!stack || max_size<maxsize){
+                if(stack) pcre2_jit_stack_free(stack);
+                stack=pcre2_jit_stack_create(startsize,maxsize,NULL);
+                max_size=stack?maxsize:0;
+            }
+            return stack;
+        }
+    };
+    
+    static thread_local ThreadJitStack thread_jit_stack;
+    
+    void jpcre2::RegexMatch::prepareJit(){
+        if(!jit_stack_max){
+            ///A stack assigned by an earlier execute() goes back to the default
+            if(mcontext) pcre2_jit_stack_assign(mcontext,NULL,NULL);
+            return;
+        }
+        if(!re->jit_compiled){
+            uint32_t jit_supported=0;
+            (void)pcre2_config(PCRE2_CONFIG_JIT,&jit_supported);
+            current_warning_msg = jit_supported ? "JIT stack not used: the pattern is not JIT compiled (use the S modifier)"
+                                                : "JIT stack not used: JIT is not supported by the PCRE2 library";
+            return;
+        }
+        if(!mcontext) mcontext=pcre2_match_context_create(re->gcontext);
+        ///NULL stack (creation failed) means the default 32K machine stack
+        pcre2_jit_stack_assign(mcontext,NULL,thread_jit_stack.get(jit_stack_start,jit_stack_max));
+    }
+    
+    bool jpcre2::RegexMatch::stopAtLimit(int rc){
+        if(!limits.hit(rc)) return false;
+        setError(limits.error,0);
+        return true;
+    }
+    
+    int jpcre2::Regex::exec(const Regex* code_re,PCRE2_SPTR subject,PCRE2_SIZE length,PCRE2_SIZE start_offset,uint32_t options,
+                            pcre2_match_data* match_data,pcre2_match_context* mcontext,bool& jit_fallback) const{
+        int rc;
+        uint64_t start_ns = stats_shards ? statsClock() : 0;
+        ///pcre2_jit_match() skips all the checks of pcre2_match(), UTF validation included,
+        ///so it's only taken when the subject is known to be valid (or the caller said so).
+        bool jit = code_re->jit_compiled && (options & ~JIT_MATCH_OPTS)==0 &&
+                   ((all_opts & PCRE2_UTF)==0 || (options & PCRE2_NO_UTF_CHECK)!=0);
+        if(jit)
+            rc=pcre2_jit_match(code_re->code,subject,length,start_offset,options,match_data,mcontext);
+        else
+            rc=pcre2_match(code_re->code,subject,length,start_offset,options,match_data,mcontext);
+        
+        #ifdef PCRE2_NO_JIT
+        if(rc==PCRE2_ERROR_JIT_STACKLIMIT){
+            ///Out of JIT stack, retry with the interpreter instead of failing
+            rc=pcre2_match(code_re->code,subject,length,start_offset,options|PCRE2_NO_JIT,match_data,mcontext);
+            jit=false;
+            jit_fallback=true;
+        }
+        #endif
+        if(stats_shards)
+            recordMatch(rc,(rc>=0 ? pcre2_get_ovector_pointer(match_data)[1] : length)-start_offset,jit,start_ns);
+        return rc;
+    }
+    
+    int jpcre2::RegexMatch::exec(PCRE2_SPTR subject,PCRE2_SIZE length,PCRE2_SIZE start_offset,uint32_t options,
+                                                                                    pcre2_match_data* match_data){
+        ///Out of time, stopAtLimit() takes it from limits.error
+        if(limits.deadline && limits.expired()) return PCRE2_ERROR_MATCHLIMIT;
+        bool jit_fallback=false;
+        int rc=re->exec(range_re ? range_re : re,subject,length,start_offset,options,match_data,mcontext,jit_fallback);
+        if(jit_fallback) current_warning_msg="JIT stack limit reached, fell back to the interpreter (see jitStack())";
+        return rc;
+    }
+    
     void jpcre2::RegexMatch::parseMatchOpts(const String& mod){
         ///This function works by retaining previous value
         
@@ -51,7 +157,7 @@ Dsclaimer:
                 case 'A': match_opts        |= PCRE2_ANCHORED;break;
                 case 'g': jpcre2_match_opts |= FIND_ALL;break;
                 default : if((jpcre2_match_opts & VALIDATE_MODIFIER)!=0)
-                          {re->error_code=re->jpcre2_error_offset=(int)mod[i];throw((int)ERROR::INVALID_MODIFIER);}break;
+                          {setModifierError((int)mod[i]);throw((int)ERROR::INVALID_MODIFIER);}break;
             }
         }
     }
@@ -59,108 +165,104 @@ Dsclaimer:
 
 
 
-    void jpcre2::RegexMatch::getNumberedSubstrings(int rc, pcre2_match_data *match_data,jpcre2::MapNum& num_map0){
+    void jpcre2::MatchSet::push(const PCRE2_SIZE* ovector,uint32_t rc){
+        for(Uint i=0;i<m_groups;i++){
+            m_start.push_back(ovector[2*i]);
+            m_end.push_back(ovector[2*i+1]);
+        }
+        m_rc.push_back(rc);
+    }
+    
+    static bool nameLess(const std::pair<jpcre2::String,jpcre2::Uint>& entry,const jpcre2::String& name){
+        return entry.first<name;
+    }
+    
+    int jpcre2::MatchSet::number(const String& name,Uint m) const{
+        if(!m_names) return -1;
+        NameTable::const_iterator it=std::lower_bound(m_names->begin(),m_names->end(),name,nameLess);
+        if(it==m_names->end() || it->first!=name) return -1;
+        int first=(int)it->second;
+        for(;it!=m_names->end() && it->first==name;++it){
+            if(isSet(m,it->second)) return (int)it->second;
+        }
+        return first;
+    }
+    
+    int jpcre2::MatchView::number(const String& name) const{
+        if(!m_names) return -1;
+        NameTable::const_iterator it=std::lower_bound(m_names->begin(),m_names->end(),name,nameLess);
+        if(it==m_names->end() || it->first!=name) return -1;
+        int first=(int)it->second;
+        for(;it!=m_names->end() && it->first==name;++it){
+            if(isSet(it->second)) return (int)it->second;
+        }
+        return first;
+    }
+    
+    ///Returns the substring of group n straight from the ovector, empty string if the group is unset.
+    static jpcre2::String getSubstring(PCRE2_SPTR subject, PCRE2_SIZE* ovector, uint32_t n){
+        PCRE2_SIZE start=ovector[2*n], end=ovector[2*n+1];
+        if(start==PCRE2_UNSET || end<start) return jpcre2::String();
+        return jpcre2::String((const char*)subject+start,end-start);
+    }
+    
+    void jpcre2::RegexMatch::getNumberedSubstrings(int rc, PCRE2_SPTR subject, PCRE2_SIZE* ovector,jpcre2::MapNum& num_map0){
+        ///The substrings are copied straight out of the subject,
+        ///pcre2_substring_get_bynumber() would allocate (and require us to free) a buffer for each of them.
         for (int i = 0; i < rc; i++){
-            String value;
-            //~ PCRE2_SPTR substring_start = subject + ovector[2*i];
-            //~ size_t substring_length = ovector[2*i+1] - ovector[2*i];
-            //~ String tmps1=jpcre2_utils::toString((char *)substring_start);
-            //~ value=tmps1.substr(0,substring_length);
-            ///If we use pcre2_substring_get_bynumber(),
-            ///we will have to deal with returned error codes and memory
-            PCRE2_UCHAR **bufferptr;
-            PCRE2_SIZE bufflen/*=REGEX_STRING_MAX*/;
-            pcre2_substring_length_bynumber(match_data,(uint32_t)i,&bufflen);
-            bufferptr=(PCRE2_UCHAR**)malloc(bufflen * sizeof(PCRE2_UCHAR));
-            int ret=pcre2_substring_get_bynumber(match_data, (uint32_t)i, bufferptr, &bufflen);
-            if(ret<0){
-                switch(ret){
-                    case PCRE2_ERROR_NOMEMORY: throw(ret);break;
-                    default:break;   ///Other errors should be ignored
-                }
-            }
-            value=jpcre2_utils::toString((char*)*bufferptr);
-            ///pcre2_substring_free(*bufferptr); 
-            ///must free memory, pcre2_substring_free() yields to segmentation fault in several cases ( try '(?<name>\d)?' )
-            /// (may be a bug?)
-            ///Instead use free() to free the memory
-            ::free(bufferptr);                  ///must free memory
-            num_map0[i]=value;
+            num_map0[i]=getSubstring(subject,ovector,(uint32_t)i);
+        }
+    }
+    
+    void jpcre2::RegexMatch::getSpans(pcre2_match_data *match_data,jpcre2::SpanNum& span_num0){
+        PCRE2_SIZE* ovector=pcre2_get_ovector_pointer(match_data);
+        uint32_t ovcount=pcre2_get_ovector_count(match_data);
+        span_num0.resize(ovcount);
+        for (uint32_t i = 0; i < ovcount; i++){
+            PCRE2_SIZE start=ovector[2*i], end=ovector[2*i+1];
+            span_num0[i].start=start;
+            span_num0[i].length=(start==PCRE2_UNSET || end<start)?0:end-start;
         }
     }
     
-    void jpcre2::RegexMatch::getNamedSubstrings(int namecount,int name_entry_size,PCRE2_SPTR tabptr, pcre2_match_data *match_data,
+    void jpcre2::RegexMatch::getNamedSubstrings(int namecount,int name_entry_size,PCRE2_SPTR tabptr, PCRE2_SPTR subject, PCRE2_SIZE* ovector,
                                                             jpcre2::MapNas& nas_map0, jpcre2::MapNtN& nn_map0){
         
-        for (int i = 0; i < namecount; i++){
-            String key,value,value1;
+        PCRE2_SPTR tabend=tabptr+namecount*name_entry_size;
+        String key,value;
+        
+        for (int i = 0; i < namecount; i++, tabptr += name_entry_size){
             
-            //~ #if PCRE2_CODE_UNIT_WIDTH == 8
+            ///In the 8-bit library the number is held in two bytes, most significant first
             int n = (tabptr[0] << 8) | tabptr[1];
-            key=jpcre2_utils::toString((char*)(tabptr+2));
-            //~ #elif PCRE2_CODE_UNIT_WIDTH == 16
-            //~ int n = tabptr[0];
-            //~ key=jpcre2_utils::toString((char*)(tabptr+1));
-            //~ #elif PCRE2_CODE_UNIT_WIDTH == 32
-            //~ int n = tabptr[0];
-            //~ key=jpcre2_utils::toString((char*)(tabptr+1));
-            //~ #else
-            //~ #error PCRE2_CODE_UNIT_WIDTH must be 8 or 16 or 32
-            //~ #endif
             
-            //~ String tmps2=jpcre2_utils::toString((char*)(subject + ovector[2*n]));
-            //~ //String key=tmps1.substr(0,name_entry_size - 3);
-            //~ value1=tmps2.substr(0,(ovector[2*n+1] - ovector[2*n]));
-            PCRE2_UCHAR **bufferptr;
-            PCRE2_SIZE bufflen/*=REGEX_STRING_MAX*/;
-            pcre2_substring_length_byname(match_data,(PCRE2_SPTR)key.c_str(),&bufflen);
-            bufferptr=(PCRE2_UCHAR **)malloc((bufflen+1) * sizeof(PCRE2_UCHAR));
-            int ret=pcre2_substring_get_byname(match_data, (PCRE2_SPTR)key.c_str(), bufferptr, &bufflen);
-            if(ret<0){
-                switch(ret){
-                    case PCRE2_ERROR_NOMEMORY: throw(ret);break;
-                    default:break;   ///Other errors should be ignored
+            ///Entries for duplicate names (J modifier) are adjacent in the name table.
+            ///The value of a name is the value of the first set group having that name,
+            ///which is what pcre2_substring_get_byname() would give us.
+            if(i==0 || key!=(const char*)(tabptr+2)){
+                key=(const char*)(tabptr+2);
+                value.clear();
+                for(PCRE2_SPTR p=tabptr; p<tabend && key==(const char*)(p+2); p+=name_entry_size){
+                    int m = (p[0] << 8) | p[1];
+                    if(ovector[2*m]!=PCRE2_UNSET){value=getSubstring(subject,ovector,(uint32_t)m);break;}
                 }
             }
-            value=jpcre2_utils::toString((char *)*bufferptr);
             
-            ///Let's get the value again, this time with number
-            ///We will match this value with the previous
-            ///If it matches, then we got the right one,
-            ///Otherwise the number is not valid for the corresponding name
-            ///we will skip this iteration, if that happens.
-            ///Don't use pcre2_substring_number_from_name() to get the number for the name (It's messy).
-            ::free(bufferptr);
-            pcre2_substring_length_bynumber(match_data,(uint32_t)n,&bufflen);
-            bufferptr=(PCRE2_UCHAR **)malloc(bufflen * sizeof(PCRE2_UCHAR));
-            ret=pcre2_substring_get_bynumber(match_data, (uint32_t)n, bufferptr, &bufflen);
-            if(ret<0){
-                switch(ret){
-                    case PCRE2_ERROR_NOMEMORY: throw(ret);break;
-                    default:break;   ///Other errors should be ignored
-                }
-            }
-            value1=jpcre2_utils::toString((char *)*bufferptr);
-            
-            ///pcre2_substring_free(*bufferptr); 
-            ///must free memory, pcre2_substring_free() yields to segmentation fault in several cases ( try '(?<name>\d)?' )
-            /// (may be a bug?)
-            ///Instead use free() to free the memory
-            ::free(bufferptr);                  ///must free memory
-            if(value!=value1){tabptr += name_entry_size;continue;}
+            ///If the value of this group doesn't match the value of the name,
+            ///then the number is not valid for the corresponding name, skip it.
+            if(getSubstring(subject,ovector,(uint32_t)n)!=value) continue;
             nas_map0[key]=value;
             nn_map0[key]=n;
-            tabptr += name_entry_size;
         }
     }
     
-    jpcre2::Uint jpcre2::RegexMatch::match(const std::string& s,VecNum& vec_num,VecNas& vec_nas,VecNtN& vec_nn,
-                                            const std::string& mod,uint32_t opt_bits,uint32_t pcre2_opts){
+    void jpcre2::RegexMatch::prepare(const std::string& mod,uint32_t opt_bits,uint32_t pcre2_opts){
         
         //Clear all verctors
-        vec_num.clear();
-        vec_nas.clear();
-        vec_nn.clear();
+        if(p_vec_num) p_vec_num->clear();
+        if(p_vec_nas) p_vec_nas->clear();
+        if(p_vec_ntn) p_vec_ntn->clear();
+        if(p_vec_span) p_vec_span->clear();
         
         ///Add opt_bits to jpcre2_match_opts before running parseMatchOpts()
         ///This may require additional filter in future
@@ -171,56 +273,56 @@ Dsclaimer:
         ///Make additions to available options
         parseMatchOpts(mod);
         
+        re->ensureJit();
+        prepareJit();
+        limits.prepare(mcontext,re->gcontext);
+    }
+    
+    jpcre2::Uint jpcre2::RegexMatch::scan(PCRE2_SPTR subject,PCRE2_SIZE subject_length,pcre2_match_data* match_data){
         
-        PCRE2_SPTR subject=(PCRE2_SPTR)s.c_str();
+        Uint count=0;
         MapNum num_map0;
         MapNas nas_map0;
         MapNtN nn_map0;
-        PCRE2_SPTR name_table;
-        int crlf_is_newline;
-        int namecount;
-        int name_entry_size;
         int rc;
-        int utf8;
-        uint32_t option_bits;
-        uint32_t newline;
         PCRE2_SIZE *ovector;
-        size_t subject_length;
-        pcre2_match_data *match_data;
-        subject_length = strlen((char *)subject);
-    
-    
-    
-        /* Using this function ensures that the block is exactly the right size for
-        the number of capturing parentheses in the pattern. */
-    
-        match_data = pcre2_match_data_create_from_pattern(re->code, NULL);
-    
-        rc = pcre2_match(
-            re->code,                 /* the compiled pattern */
+        
+        /* The pattern info used below (name table, UTF and newline convention)
+        was read once, when the pattern was compiled. */
+        
+        int namecount = re->name_count;
+        int name_entry_size = re->name_entry_size;
+        bool want_names = namecount > 0 && (p_vec_nas || p_vec_ntn);
+        
+        /* A subject without the required literal of the pattern can't match. */
+        
+        if(!re->prefilter(subject,subject_length,match_opts)){
+            setError(PCRE2_ERROR_NOMATCH,PCRE2_ERROR_NOMATCH);
+            return count;
+        }
+        
+        rc = exec(
             subject,              /* the subject string */
             subject_length,       /* the length of the subject */
             0,                    /* start at offset 0 in the subject */
-            match_opts,                    /* default options */
-            match_data,           /* block for storing the result */
-            NULL);                /* use default match context */
+            match_opts,           /* default options */
+            match_data);          /* block for storing the result */
     
             /* Matching failed: handle error cases */
     
-        re->error_code=rc;
-        re->error_offset=rc;
+        setError(rc,rc);
         
         if (rc < 0){
-            pcre2_match_data_free(match_data);      /* Release memory used for the match */
             //pcre2_code_free(code);                //must not free code. This function has no right to modify regex
             switch(rc){
-                case PCRE2_ERROR_NOMATCH: return vec_num.size(); break;
+                case PCRE2_ERROR_NOMATCH: return count; break;
                 /*
                 Handle other special cases if you like
                 */
-                default: throw(rc); break;
+                default: if(stopAtLimit(rc)) return count;
+                         throw(rc); break;
             }
-            return vec_num.size();
+            return count;
         }
     
         /* Match succeded. Get a pointer to the output vector, where string offsets are
@@ -240,12 +342,19 @@ Dsclaimer:
     
         if (rc == 0){
             //ovector was not big enough for all the captured substrings;
-            return vec_num.size();
+            return count;
       
         }
     
         ///Let's get the numbered substrings
-        getNumberedSubstrings(rc,match_data,num_map0);
+        if(p_vec_num) getNumberedSubstrings(rc,subject,ovector,num_map0);
+        
+        ///and the spans
+        if(p_vec_span){
+            p_vec_span->push_back(SpanNum());
+            getSpans(match_data,p_vec_span->back());
+        }
+        if(p_match_set) p_match_set->push(ovector,(uint32_t)rc);
         
         
         
@@ -257,48 +366,20 @@ Dsclaimer:
         * repeated matches on the same subject.                                   *
         **************************************************************************/
     
-        /* See if there are any named substrings, and if so, show them by name. First
-        we have to extract the count of named parentheses from the pattern. */
-    
-        (void)pcre2_pattern_info(
-        re->code,                       /* the compiled pattern */
-        PCRE2_INFO_NAMECOUNT,       /* get the number of named substrings */
-        &namecount);                /* where to put the answer */
-    
-        if (namecount <= 0);        /*No named substrings*/
-        
-        else{
-            PCRE2_SPTR tabptr;
-            
-            /* Before we can access the substrings, we must extract the table for
-            translating names to numbers, and the size of each entry in the table. */
-    
-            (void)pcre2_pattern_info(
-            re->code,                           /* the compiled pattern */
-            PCRE2_INFO_NAMETABLE,           /* address of the table */
-            &name_table);                   /* where to put the answer */
-    
-            (void)pcre2_pattern_info(
-            re->code,                           /* the compiled pattern */
-            PCRE2_INFO_NAMEENTRYSIZE,       /* size of each entry in the table */
-            &name_entry_size);              /* where to put the answer */
-    
-            /* Now we can scan the table and, for each entry, print the number, the name,
-            and the substring itself. In the 8-bit library the number is held in two
-            bytes, most significant first. */
+        /* See if there are any named substrings, and if so, show them by name. In the
+        8-bit library the number is held in two bytes, most significant first. */
     
-            tabptr = name_table;
-            
+        if(want_names){
             ///Let's get the named substrings
-            getNamedSubstrings(namecount,name_entry_size,tabptr,match_data,nas_map0,nn_map0);
-            
+            getNamedSubstrings(namecount,name_entry_size,re->name_entries,subject,ovector,nas_map0,nn_map0);
         }
         
         
         ///populate vector
-        vec_num.push_back(num_map0);
-        vec_nas.push_back(nas_map0);
-        vec_nn.push_back(nn_map0);
+        if(p_vec_num) p_vec_num->push_back(num_map0);
+        if(p_vec_nas) p_vec_nas->push_back(nas_map0);
+        if(p_vec_ntn) p_vec_ntn->push_back(nn_map0);
+        count++;
     
         /*************************************************************************
         * If the "-g" option was given on the command line, we want to continue  *
@@ -330,25 +411,15 @@ Dsclaimer:
         *************************************************************************/
     
         if ((jpcre2_match_opts & FIND_ALL) == 0){
-            pcre2_match_data_free(match_data);      /* Release the memory that was used */
             //pcre2_code_free(re);                  /// Don't do this. This function has no right to modify regex.
-            return vec_num.size();                           /* Exit the program. */
+            return count;                           /* Exit the program. */
         }
     
         /* Before running the loop, check for UTF-8 and whether CRLF is a valid newline
-        sequence. First, find the options with which the regex was compiled and extract
-        the UTF state. */
+        sequence. Both were taken from the compiled pattern by Regex::readPatternInfo(). */
     
-        (void)pcre2_pattern_info(re->code, PCRE2_INFO_ALLOPTIONS, &option_bits);
-        utf8 = (option_bits & PCRE2_UTF) != 0;
-        
-        /* Now find the newline convention and see whether CRLF is a valid newline
-        sequence. */
-        
-        (void)pcre2_pattern_info(re->code, PCRE2_INFO_NEWLINE, &newline);
-        crlf_is_newline = newline == PCRE2_NEWLINE_ANY ||
-                          newline == PCRE2_NEWLINE_CRLF ||
-                          newline == PCRE2_NEWLINE_ANYCRLF;
+        bool utf8 = (re->all_opts & PCRE2_UTF) != 0;
+        bool crlf_is_newline = re->crlf_is_newline;
         
         /* Loop for second and subsequent matches */
     
@@ -356,7 +427,7 @@ Dsclaimer:
             num_map0.clear();                         ///must clear map before filling it with new values
             nas_map0.clear();
             nn_map0.clear();
-            uint32_t options = match_opts;                       /* Normally no options */
+            uint32_t retry_opts = 0;                    /* Set only to retry after an empty match */
             PCRE2_SIZE start_offset = ovector[1];       /* Start at end of previous match */
             
             /* If the previous match was for an empty string, we are finished if we are
@@ -365,21 +436,19 @@ Dsclaimer:
             
             if (ovector[0] == ovector[1]){
                 if (ovector[0] == subject_length) break;
-                options |= PCRE2_NOTEMPTY_ATSTART | PCRE2_ANCHORED;
+                retry_opts = PCRE2_NOTEMPTY_ATSTART | PCRE2_ANCHORED;
                 }
             
               /* Run the next matching operation */
             
-            rc = pcre2_match(
-                re->code,                 /* the compiled pattern */
+            rc = exec(
                 subject,              /* the subject string */
                 subject_length,       /* the length of the subject */
                 start_offset,         /* starting offset in the subject */
-                options,              /* options */
-                match_data,           /* block for storing the result */
-                NULL);                /* use default match context */
+                match_opts | retry_opts | PCRE2_NO_UTF_CHECK, /* the subject was checked by the first match */
+                match_data);          /* block for storing the result */
             
-            /* This time, a result of NOMATCH isn't an error. If the value in "options"
+            /* This time, a result of NOMATCH isn't an error. If the value in "retry_opts"
             is zero, it just means we have found all possible matches, so the loop ends.
             Otherwise, it means we have failed to find a non-empty-string match at a
             point where there was a previous empty-string match. In this case, we do what
@@ -393,7 +462,7 @@ Dsclaimer:
             UTF mode. */
             
             if (rc == PCRE2_ERROR_NOMATCH){
-                if (options == 0) break;                                    /* All matches found */
+                if (retry_opts == 0) break;                                 /* All matches found */
                 ovector[1] = start_offset + 1;                              /* Advance one code unit */
                 if (crlf_is_newline &&                                      /* If CRLF is newline & */
                     start_offset < subject_length - 1 &&                    /* we are at CRLF, */
@@ -412,9 +481,9 @@ Dsclaimer:
               /* Other matching errors are not recoverable. */
             
             if (rc < 0){
-                pcre2_match_data_free(match_data);
                 //pcre2_code_free(code);           //must not do this. This function has no right to modify regex.
-                return vec_num.size();
+                stopAtLimit(rc);
+                return count;
             }
             
             
@@ -422,32 +491,249 @@ Dsclaimer:
             if (rc == 0){
                 /* The match succeeded, but the output vector wasn't big enough. This
                 should not happen. */
-                return vec_num.size();
+                return count;
             }
             
             /* As before, get substrings stored in the output vector by number, and then
             also any named substrings. */
             
             ///Let's get the numbered substrings
-            getNumberedSubstrings(rc,match_data,num_map0);
+            if(p_vec_num) getNumberedSubstrings(rc,subject,ovector,num_map0);
             
-            if (namecount <= 0);  /*No named substrings*/
-            else{
-                PCRE2_SPTR tabptr = name_table;
-                
+            ///and the spans
+            if(p_vec_span){
+                p_vec_span->push_back(SpanNum());
+                getSpans(match_data,p_vec_span->back());
+            }
+            if(p_match_set) p_match_set->push(ovector,(uint32_t)rc);
+            
+            if(want_names){
                 ///Let's get the named substrings
-                getNamedSubstrings(namecount,name_entry_size,tabptr,match_data,nas_map0,nn_map0);
+                getNamedSubstrings(namecount,name_entry_size,re->name_entries,subject,ovector,nas_map0,nn_map0);
             }
             
             
             ///populate vector
-            vec_num.push_back(num_map0);
-            vec_nas.push_back(nas_map0);
-            vec_nn.push_back(nn_map0);
+            if(p_vec_num) p_vec_num->push_back(num_map0);
+            if(p_vec_nas) p_vec_nas->push_back(nas_map0);
+            if(p_vec_ntn) p_vec_ntn->push_back(nn_map0);
+            count++;
             
         }      /* End of loop to find second and subsequent matches */
     
-        pcre2_match_data_free(match_data);
         /// Must not free pcre2_code* code. This function has no right to modify regex.
-        return vec_num.size();
+        return count;
+    }
+    
+    jpcre2::Uint jpcre2::RegexMatch::match(PCRE2_SPTR subject,PCRE2_SIZE subject_length,
+                                            const std::string& mod,uint32_t opt_bits,uint32_t pcre2_opts){
+        Uint count;
+        
+        prepare(mod,opt_bits,pcre2_opts);
+        
+        /* The pool hands out blocks that are exactly the right size for the number
+        of capturing parentheses in the pattern, creating one only when it is empty. */
+        
+        pcre2_match_data *match_data = re->md_pool.checkout(re->code);
+        
+        if(p_match_set) p_match_set->init(pcre2_get_ovector_count(match_data),&re->name_table);
+        
+        try{
+            count=scan(subject,subject_length,match_data);
+        }
+        catch(...){
+            re->md_pool.checkin(match_data);        /* Return the block to the pool */
+            throw;
+        }
+        re->md_pool.checkin(match_data);
+        return count;
+    }
+    
+    jpcre2::Uint jpcre2::RegexMatch::countMatches(bool all){
+        PCRE2_SPTR subject=(PCRE2_SPTR)(p_subject?p_subject:m_subject.data());
+        PCRE2_SIZE subject_length=p_subject?p_subject_len:m_subject.size();
+        
+        ///Only options are set up, no result vector is touched
+        parseMatchOpts(m_modifier);
+        re->ensureJit();
+        prepareJit();
+        limits.prepare(mcontext,re->gcontext);
+        
+        if(!re->prefilter(subject,subject_length,match_opts)){
+            setError(PCRE2_ERROR_NOMATCH,PCRE2_ERROR_NOMATCH);
+            return 0;
+        }
+        
+        bool utf8 = (re->all_opts & PCRE2_UTF) != 0;
+        Uint count=0;
+        PCRE2_SIZE start_offset=0;
+        uint32_t options=match_opts,retry_opts=0;
+        
+        ///One ovector pair is enough to go on from a match. A pattern with captures
+        ///returns 0 for it (ovector too small), which is still a match.
+        pcre2_match_data *match_data = re->md_pool_min.checkout(re->code,re->gcontext);
+        PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(match_data);
+        
+        try{
+            for(;;){
+                int rc=exec(subject,subject_length,start_offset,options | retry_opts,match_data);
+                
+                if(rc == PCRE2_ERROR_NOMATCH){
+                    if(retry_opts == 0) break;
+                    ///No non-empty match where the empty one was, advance one character
+                    retry_opts=0;
+                    start_offset+=1;
+                    if(re->crlf_is_newline && start_offset<subject_length &&
+                       subject[start_offset-1]=='\r' && subject[start_offset]=='\n') start_offset+=1;
+                    else if(utf8){
+                        while(start_offset<subject_length && (subject[start_offset] & 0xc0)==0x80) start_offset+=1;
+                    }
+                    continue;
+                }
+                if(rc < 0){
+                    if(stopAtLimit(rc)) break;
+                    setError(rc,rc);
+                    throw(rc);
+                }
+                count++;
+                
+                if(!all || ovector[1]<ovector[0]) break;    ///\K can end a match before its start
+                options |= PCRE2_NO_UTF_CHECK;              ///the subject was checked by the first match
+                start_offset=ovector[1];
+                if(ovector[0]==ovector[1]){
+                    if(ovector[0]==subject_length) break;
+                    retry_opts=PCRE2_NOTEMPTY_ATSTART | PCRE2_ANCHORED;
+                }
+                else retry_opts=0;
+            }
+        }
+        catch(...){
+            re->md_pool_min.checkin(match_data);
+            throw;
+        }
+        re->md_pool_min.checkin(match_data);
+        if(!limits.error) setError(count?(int)count:PCRE2_ERROR_NOMATCH,count);
+        return count;
+    }
+    
+    jpcre2::Uint jpcre2::RegexMatch::executeBatch(const String* subjects,Uint n,std::vector<Uint>& counts){
+        Uint total=0;
+        
+        ///Options, JIT stack and match data are set up once for the whole batch
+        prepare(m_modifier,jpcre2_match_opts,match_opts);
+        counts.assign(n,0);
+        
+        pcre2_match_data *match_data = re->md_pool.checkout(re->code);
+        
+        if(p_match_set) p_match_set->init(pcre2_get_ovector_count(match_data),&re->name_table);
+        
+        try{
+            for(Uint i=0;i<n;i++){
+                counts[i]=scan((PCRE2_SPTR)subjects[i].data(),subjects[i].size(),match_data);
+                total+=counts[i];
+            }
+        }
+        catch(...){
+            re->md_pool.checkin(match_data);
+            throw;
+        }
+        re->md_pool.checkin(match_data);
+        return total;
+    }
+    
+    
+    jpcre2::MatchRange jpcre2::RegexMatch::iterate(){
+        prepare(m_modifier,jpcre2_match_opts,match_opts);
+        const char* s=p_subject?p_subject:m_subject.data();
+        PCRE2_SIZE len=p_subject?p_subject_len:m_subject.size();
+        return MatchRange(this,s,len);
+    }
+    
+    jpcre2::MatchRange::MatchRange(RegexMatch* m,const char* subject,PCRE2_SIZE length)
+                        :view(subject,0,nullptr,0,&m->re->name_table){
+        rm=m;
+        m_subject=subject;
+        m_length=length;
+        options=rm->match_opts;
+        retry_opts=0;
+        next_start=0;
+        global=(rm->jpcre2_match_opts & FIND_ALL)!=0;
+        started=false;
+        ///A subject without the required literal of the pattern can't match
+        more=rm->re->prefilter((PCRE2_SPTR)subject,length,options);
+        match_data=more?rm->re->md_pool.checkout(rm->re->code):nullptr;
+    }
+    
+    jpcre2::MatchRange::MatchRange(MatchRange&& x):view(x.view){
+        rm=x.rm;
+        m_subject=x.m_subject;
+        m_length=x.m_length;
+        match_data=x.match_data;
+        options=x.options;
+        retry_opts=x.retry_opts;
+        next_start=x.next_start;
+        global=x.global;
+        started=x.started;
+        more=x.more;
+        x.match_data=nullptr;
+        x.more=false;
+    }
+    
+    jpcre2::MatchRange::~MatchRange(){
+        if(match_data) rm->re->md_pool.checkin(match_data);
+    }
+    
+    jpcre2::MatchRange::iterator jpcre2::MatchRange::begin(){
+        if(!started){
+            started=true;
+            advance();
+        }
+        return iterator(more?this:nullptr);
+    }
+    
+    void jpcre2::MatchRange::advance(){
+        ///The second half of RegexMatch::scan(), one match per call
+        if(!more) return;
+        if(view.m_ovector && !global){more=false;return;}
+        
+        const Regex* re=rm->re;
+        bool utf = (re->all_opts & PCRE2_UTF) != 0;
+        PCRE2_SIZE* ovector = pcre2_get_ovector_pointer(match_data);
+        
+        for(;;){
+            int rc=rm->exec((PCRE2_SPTR)m_subject,m_length,next_start,options | retry_opts,match_data);
+            
+            if(rc == PCRE2_ERROR_NOMATCH){
+                if(retry_opts == 0){more=false;return;}
+                ///No non-empty match where the empty one was, advance one character
+                retry_opts=0;
+                next_start+=1;
+                if(re->crlf_is_newline && next_start<m_length &&
+                   m_subject[next_start-1]=='\r' && m_subject[next_start]=='\n') next_start+=1;
+                else if(utf){
+                    while(next_start<m_length && ((unsigned char)m_subject[next_start] & 0xc0)==0x80) next_start+=1;
+                }
+                continue;
+            }
+            if(rc < 0){
+                more=false;
+                if(rm->stopAtLimit(rc)) return;
+                rm->setError(rc,rc);
+                throw(rc);
+            }
+            break;
+        }
+        
+        view.m_ovector=ovector;
+        view.m_groups=pcre2_get_ovector_count(match_data);
+        options |= PCRE2_NO_UTF_CHECK;          ///the subject was checked by the first match
+        
+        ///\K in a lookaround can end a match before its start, stop after it instead of looping
+        if(ovector[1]<ovector[0]){global=false;return;}
+        next_start=ovector[1];
+        if(ovector[0]==ovector[1]){
+            if(ovector[0]==m_length) global=false;
+            else retry_opts=PCRE2_NOTEMPTY_ATSTART | PCRE2_ANCHORED;
+        }
+        else retry_opts=0;
     }
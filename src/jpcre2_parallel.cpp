@@ -0,0 +1,605 @@
+/***********************************************************************
+ * C++ wrapper for several utilities of PCRE2 Library
+ * ********************************************************************/
+
+/* 
+This is a public C++ wrapper for several utilities of the PCRE library, second API, to be
+#included by applications that call PCRE2 functions.
+
+           Copyright (c) 2015 Md. Jahidul Hamid
+
+-----------------------------------------------------------------------------
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * The names of its contributors may be used to endorse or promote 
+      products derived from this software without specific prior written
+      permission.
+      
+Dsclaimer:
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+    
+*/
+
+
+#include "jpcre2.h"
+    
+    
+    ///Number of tasks handed to each thread up front. More, smaller tasks balance
+    ///uneven subjects better at the cost of some scheduling.
+    static const jpcre2::Uint TASKS_PER_THREAD = 8;
+    
+    ///A huge subject isn't cut into pieces smaller than this, and a batch smaller
+    ///than this in all is done on the calling thread
+    static const jpcre2::Uint MIN_PIECE_SIZE = 65536;
+    
+    
+    ///Task queue of one worker. Its owner takes tasks from the front,
+    ///other workers steal from the back once their own queue is empty.
+    struct TaskQueue{
+        std::mutex lock;
+        std::deque<jpcre2::Uint> tasks;
+        
+        bool pop(jpcre2::Uint& task){
+            std::lock_guard<std::mutex> guard(lock);
+            if(tasks.empty()) return false;
+            task=tasks.front();
+            tasks.pop_front();
+            return true;
+        }
+        
+        bool steal(jpcre2::Uint& task){
+            std::lock_guard<std::mutex> guard(lock);
+            if(tasks.empty()) return false;
+            task=tasks.back();
+            tasks.pop_back();
+            return true;
+        }
+    };
+    
+    ///Threads kept by runTasks() from call to call. A thread is started only when a job
+    ///finds none waiting, so the pool grows to the most threads asked for at once.
+    ///It's never destroyed: its threads wait for jobs until exit.
+    class WorkerPool{
+        
+        private:
+        
+            std::mutex lock;
+            std::condition_variable wake;
+            std::deque<std::function<void()> > jobs;
+            jpcre2::Uint idle;          ///threads waiting for a job
+            
+            void run(){
+                for(;;){
+                    std::function<void()> job;
+                    {
+                        std::unique_lock<std::mutex> guard(lock);
+                        idle++;
+                        wake.wait(guard,[this]{return !jobs.empty();});
+                        idle--;
+                        job=std::move(jobs.front());
+                        jobs.pop_front();
+                    }
+                    job();
+                }
+            }
+            
+        public:
+        
+            WorkerPool(){idle=0;}
+            
+            ///Runs job on a thread of the pool. If no thread can be started, the job waits for one to be free.
+            void post(std::function<void()> job){
+                std::lock_guard<std::mutex> guard(lock);
+                jobs.push_back(std::move(job));
+                if(jobs.size()<=idle){
+                    wake.notify_one();
+                    return;
+                }
+                try{std::thread(&WorkerPool::run,this).detach();}
+                catch(...){}
+            }
+    };
+    
+    static WorkerPool& workerPool(){
+        static WorkerPool* pool=new WorkerPool;
+        return *pool;
+    }
+    
+    static jpcre2::Uint threadCount(jpcre2::Uint threads){
+        if(threads==0) threads=std::thread::hardware_concurrency();
+        return threads?threads:1;
+    }
+    
+    ///Runs fn(worker,task) for every task in [0,ntasks) on nthreads threads, the calling thread
+    ///being one of them and the others taken from the WorkerPool. Each worker starts with a contiguous
+    ///run of tasks, no task is added later, so a worker is done when its own queue and all others are empty.
+    ///A helper that hasn't started when the calling thread is done isn't waited for: it has nothing left to do.
+    ///The first exception thrown by fn stops all workers and is rethrown here.
+    static void runTasks(jpcre2::Uint ntasks,jpcre2::Uint nthreads,
+                         const std::function<void(jpcre2::Uint,jpcre2::Uint)>& fn){
+        if(nthreads>ntasks) nthreads=ntasks;
+        if(nthreads<=1){
+            for(jpcre2::Uint t=0;t<ntasks;t++) fn(0,t);
+            return;
+        }
+        
+        std::unique_ptr<TaskQueue[]> queues(new TaskQueue[nthreads]);
+        for(jpcre2::Uint w=0;w<nthreads;w++){
+            for(jpcre2::Uint t=ntasks*w/nthreads;t<ntasks*(w+1)/nthreads;t++) queues[w].tasks.push_back(t);
+        }
+        
+        std::atomic<bool> failed(false);
+        std::exception_ptr error;
+        std::mutex error_lock;
+        
+        auto worker=[&](jpcre2::Uint w){
+            try{
+                jpcre2::Uint task;
+                while(!failed.load(std::memory_order_relaxed)){
+                    bool found=queues[w].pop(task);
+                    for(jpcre2::Uint i=1;!found && i<nthreads;i++) found=queues[(w+i)%nthreads].steal(task);
+                    if(!found) break;
+                    fn(w,task);
+                }
+            }
+            catch(...){
+                std::lock_guard<std::mutex> guard(error_lock);
+                if(!error) error=std::current_exception();
+                failed=true;
+            }
+        };
+        
+        ///Outlives this call in the jobs of helpers that start late, which then return at once
+        struct Helpers{
+            std::mutex lock;
+            std::condition_variable done;
+            jpcre2::Uint running;
+            bool closed;
+            Helpers(){running=0;closed=false;}
+        };
+        std::shared_ptr<Helpers> helpers=std::make_shared<Helpers>();
+        
+        for(jpcre2::Uint w=1;w<nthreads;w++){
+            workerPool().post([helpers,&worker,w]{
+                {
+                    std::lock_guard<std::mutex> guard(helpers->lock);
+                    if(helpers->closed) return;
+                    helpers->running++;
+                }
+                worker(w);
+                std::lock_guard<std::mutex> guard(helpers->lock);
+                if(--helpers->running==0) helpers->done.notify_all();
+            });
+        }
+        worker(0);
+        {
+            std::unique_lock<std::mutex> guard(helpers->lock);
+            helpers->closed=true;
+            helpers->done.wait(guard,[&]{return helpers->running==0;});
+        }
+        
+        if(error) std::rethrow_exception(error);
+    }
+    
+    ///Cuts a subject into pieces of about equal size, each one ending just after a newline
+    ///(except the last). Pieces are given as offset and length pairs.
+    static void splitLines(const jpcre2::String& subject,jpcre2::Uint nthreads,
+                           std::vector<std::pair<jpcre2::Uint,jpcre2::Uint> >& pieces){
+        jpcre2::Uint size=subject.size();
+        jpcre2::Uint target=size/(nthreads*TASKS_PER_THREAD);
+        if(target<MIN_PIECE_SIZE) target=MIN_PIECE_SIZE;
+        
+        pieces.clear();
+        jpcre2::Uint start=0;
+        while(start<size){
+            jpcre2::Uint end=size;
+            if(size-start>target){
+                const void* nl=std::memchr(subject.data()+start+target,'\n',size-start-target);
+                if(nl) end=(const char*)nl-subject.data()+1;
+            }
+            pieces.push_back(std::make_pair(start,end-start));
+            start=end;
+        }
+        if(pieces.empty()) pieces.push_back(std::make_pair((jpcre2::Uint)0,(jpcre2::Uint)0));
+    }
+    
+    ///Total size of a batch, for the threshold under which it's done on the calling thread
+    static jpcre2::Uint batchSize(const std::vector<jpcre2::String>& subjects){
+        jpcre2::Uint size=0;
+        for(size_t i=0;i<subjects.size() && size<MIN_PIECE_SIZE;i++) size+=subjects[i].size();
+        return size;
+    }
+    
+    ///Only a global, unanchored match gives the same result piece by piece. An anchored
+    ///one goes on from where the last match ended, which is known to the pieces before only.
+    static bool isSplittable(const jpcre2::String& mod,uint32_t all_opts){
+        return mod.find('g')!=jpcre2::String::npos && mod.find('A')==jpcre2::String::npos &&
+               (all_opts & PCRE2_ANCHORED)==0;
+    }
+    
+    typedef std::pair<PCRE2_SIZE,PCRE2_SIZE> MatchBounds;
+    
+    ///Matches of one piece of a subject. bounds has the start and end of each.
+    struct PieceMatches{
+        jpcre2::VecNum num;
+        jpcre2::VecSpan span;
+        std::vector<MatchBounds> bounds;
+        
+        ///The matches of redo, then those of this piece from match k on
+        void splice(PieceMatches& redo,size_t k,const char*){
+            redo.num.insert(redo.num.end(),std::make_move_iterator(num.begin()+std::min(k,num.size())),
+                            std::make_move_iterator(num.end()));
+            redo.span.insert(redo.span.end(),std::make_move_iterator(span.begin()+std::min(k,span.size())),
+                             std::make_move_iterator(span.end()));
+            redo.bounds.insert(redo.bounds.end(),bounds.begin()+k,bounds.end());
+            std::swap(*this,redo);
+        }
+    };
+    
+    ///Replaced text of one piece of a subject. at[i] is where the replacement of match i starts in out.
+    struct PieceReplaced{
+        jpcre2::String out;
+        std::vector<MatchBounds> bounds;
+        std::vector<size_t> at;
+        PCRE2_SIZE copied;          ///the subject up to here is in out
+        
+        ///redo (with the subject up to the start of match k), then what this piece has from match k on
+        void splice(PieceReplaced& redo,size_t k,const char* subject){
+            redo.out.append(subject+redo.copied,bounds[k].first-redo.copied);
+            for(size_t i=k;i<at.size();i++) redo.at.push_back(at[i]-at[k]+redo.out.size());
+            redo.out.append(out,at[k],jpcre2::String::npos);
+            redo.bounds.insert(redo.bounds.end(),bounds.begin()+k,bounds.end());
+            redo.copied=copied;
+            std::swap(*this,redo);
+        }
+    };
+    
+    ///index of the match of bounds that is m, bounds.size() if there's none
+    static size_t findMatch(const std::vector<MatchBounds>& bounds,const MatchBounds& m){
+        std::vector<MatchBounds>::const_iterator it=std::lower_bound(bounds.begin(),bounds.end(),m);
+        return it!=bounds.end() && *it==m ? it-bounds.begin() : bounds.size();
+    }
+    
+    ///The pieces are matched at the same time, each from its own start, as if the matches
+    ///of the piece before ended there. Where one didn't, but ran into the next piece, that piece is
+    ///matched again (by rematch, on the calling thread) from the end of that match, up to the first
+    ///match the first pass found too: the global match loop goes the same way from there on.
+    ///rematch(t,from,redo) returns the index of that match in the matches of piece t, or their number.
+    template<class Piece,class Rematch>
+    static void joinPieces(std::vector<Piece>& done,const std::vector<std::pair<jpcre2::Uint,jpcre2::Uint> >& pieces,
+                           const char* subject,const Rematch& rematch){
+        PCRE2_SIZE reach=0;         ///end of the last match so far
+        for(size_t t=0;t<done.size();t++){
+            PCRE2_SIZE end=pieces[t].first+pieces[t].second;
+            if(reach>pieces[t].first){
+                Piece redo;
+                size_t k=done[t].bounds.size();
+                if(reach<end) k=rematch(t,reach,redo);
+                if(k<done[t].bounds.size()) done[t].splice(redo,k,subject);
+                else{
+                    ///Nothing in common, not even the end
+                    if(!redo.bounds.empty()) reach=redo.bounds.back().second;
+                    std::swap(done[t],redo);
+                    continue;
+                }
+            }
+            if(!done[t].bounds.empty()) reach=std::max(reach,done[t].bounds.back().second);
+        }
+    }
+    
+    ///Throws the error execute() gives for a subject that isn't valid UTF. The pieces are matched
+    ///with PCRE2_NO_UTF_CHECK, as each check would go on to the end of the subject.
+    static void checkUtf(PCRE2_SPTR subject,PCRE2_SIZE length,uint32_t all_opts){
+        if((all_opts & PCRE2_UTF)==0) return;
+        #ifdef PCRE2_MATCH_INVALID_UTF
+        if(all_opts & PCRE2_MATCH_INVALID_UTF) return;
+        #endif
+        ///An empty pattern matches at once, after the check
+        static pcre2_code* probe=[]{
+            int error_number;
+            PCRE2_SIZE error_offset;
+            return pcre2_compile((PCRE2_SPTR)"",0,PCRE2_UTF,&error_number,&error_offset,NULL);
+        }();
+        pcre2_match_data* match_data=pcre2_match_data_create(1,NULL);
+        int rc=pcre2_match(probe,subject,length,0,0,match_data,NULL);
+        pcre2_match_data_free(match_data);
+        if(rc<0) throw(rc);
+    }
+    
+    
+    jpcre2::Uint jpcre2::RegexMatch::scanRange(PCRE2_SPTR subject,PCRE2_SIZE length,PCRE2_SIZE start,PCRE2_SIZE end,
+                                               const std::function<bool(int,pcre2_match_data*)>& on_match){
+        prepare(m_modifier,jpcre2_match_opts,match_opts);
+        
+        ///A search gives up past the end of the range instead of going on to the end of the subject
+        if(range_re){
+            if(!mcontext) mcontext=pcre2_match_context_create(re->gcontext);
+            pcre2_set_offset_limit(mcontext,end<length ? end-1 : PCRE2_UNSET);
+        }
+        
+        bool utf8 = (re->all_opts & PCRE2_UTF) != 0;
+        Uint count=0;
+        PCRE2_SIZE start_offset=start;
+        uint32_t options=match_opts | PCRE2_NO_UTF_CHECK,retry_opts=0;
+        
+        pcre2_match_data *match_data = re->md_pool.checkout(re->code);
+        PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(match_data);
+        
+        try{
+            for(;;){
+                int rc=exec(subject,length,start_offset,options | retry_opts,match_data);
+                
+                if(rc == PCRE2_ERROR_NOMATCH){
+                    if(retry_opts == 0) break;
+                    ///No non-empty match where the empty one was, advance one character
+                    retry_opts=0;
+                    start_offset+=1;
+                    if(re->crlf_is_newline && start_offset<length &&
+                       subject[start_offset-1]=='\r' && subject[start_offset]=='\n') start_offset+=1;
+                    else if(utf8){
+                        while(start_offset<length && (subject[start_offset] & 0xc0)==0x80) start_offset+=1;
+                    }
+                    continue;
+                }
+                if(rc < 0){
+                    if(stopAtLimit(rc)) break;
+                    setError(rc,rc);
+                    throw(rc);
+                }
+                count++;
+                
+                if(!on_match(rc,match_data) || ovector[1]<ovector[0]) break;    ///\K can end a match before its start
+                start_offset=ovector[1];
+                if(ovector[0]==ovector[1]){
+                    if(ovector[0]==length) break;
+                    retry_opts=PCRE2_NOTEMPTY_ATSTART | PCRE2_ANCHORED;
+                }
+                else retry_opts=0;
+            }
+        }
+        catch(...){
+            re->md_pool.checkin(match_data);
+            throw;
+        }
+        re->md_pool.checkin(match_data);
+        return count;
+    }
+    
+    
+    jpcre2::Uint jpcre2::Regex::matchParallel(const std::vector<String>& subjects,std::vector<Uint>& counts,const String& mod,
+                                              VecNum* vec_num,VecSpan* vec_span,Uint threads) const{
+        Uint n=subjects.size();
+        Uint nthreads=batchSize(subjects)<MIN_PIECE_SIZE ? 1 : threadCount(threads);
+        Uint ntasks=std::min(n,nthreads*TASKS_PER_THREAD);
+        
+        counts.assign(n,0);
+        if(vec_num) vec_num->clear();
+        if(vec_span) vec_span->clear();
+        
+        ///Each task matches a contiguous run of subjects into results of its own,
+        ///which are joined in task order afterwards.
+        std::vector<VecNum> task_num(vec_num?ntasks:0);
+        std::vector<VecSpan> task_span(vec_span?ntasks:0);
+        
+        runTasks(ntasks,nthreads,[&](Uint,Uint t){
+            Uint begin=n*t/ntasks,end=n*(t+1)/ntasks;
+            std::vector<Uint> task_counts;
+            RegexMatch rm(*this);
+            rm.modifiers(mod);
+            if(vec_num) rm.numberedSubstringVector(task_num[t]);
+            if(vec_span) rm.numberedSpanVector(task_span[t]);
+            rm.executeBatch(subjects.data()+begin,end-begin,task_counts);
+            std::copy(task_counts.begin(),task_counts.end(),counts.begin()+begin);
+        });
+        
+        Uint total=0;
+        for(Uint i=0;i<n;i++) total+=counts[i];
+        if(vec_num){
+            vec_num->reserve(total);
+            for(Uint t=0;t<ntasks;t++) std::move(task_num[t].begin(),task_num[t].end(),std::back_inserter(*vec_num));
+        }
+        if(vec_span){
+            vec_span->reserve(total);
+            for(Uint t=0;t<ntasks;t++) std::move(task_span[t].begin(),task_span[t].end(),std::back_inserter(*vec_span));
+        }
+        return total;
+    }
+    
+    jpcre2::Uint jpcre2::Regex::matchParallel(const String& subject,const String& mod,VecNum* vec_num,VecSpan* vec_span,
+                                              Uint threads) const{
+        Uint nthreads=threadCount(threads);
+        std::vector<std::pair<Uint,Uint> > pieces;
+        
+        if(vec_num) vec_num->clear();
+        if(vec_span) vec_span->clear();
+        if(isSplittable(mod,all_opts)) splitLines(subject,nthreads,pieces);
+        
+        if(pieces.size()<2){
+            RegexMatch rm(*this);
+            rm.subject(&subject).modifiers(mod);
+            if(vec_num) rm.numberedSubstringVector(*vec_num);
+            if(vec_span) rm.numberedSpanVector(*vec_span);
+            return rm.execute();
+        }
+        
+        PCRE2_SPTR s=(PCRE2_SPTR)subject.data();
+        PCRE2_SIZE length=subject.size();
+        checkUtf(s,length,all_opts);
+        if(!prefilter(s,length,PCRE2_NO_UTF_CHECK)) return 0;
+        
+        ///The pattern again, with offset limits allowed
+        Regex limited;
+        limited.allocator(user_allocator);
+        limited.compileRegex(pat_str,modifier,mylocale,jpcre2_compile_opts,compile_opts | PCRE2_USE_OFFSET_LIMIT);
+        
+        Uint ntasks=pieces.size();
+        std::vector<PieceMatches> done(ntasks);
+        
+        ///Matches piece t from offset from. Matching again, it stops at a match of known (the matches
+        ///of the first pass) and returns its index, known->size() if there's none.
+        auto match=[&](Uint t,PCRE2_SIZE from,PieceMatches& piece,const std::vector<MatchBounds>* known)->size_t{
+            size_t k=known?known->size():0;
+            RegexMatch rm(*this);
+            rm.range_re=&limited;
+            rm.modifiers(mod);
+            rm.scanRange(s,length,from,pieces[t].first+pieces[t].second,[&](int rc,pcre2_match_data* match_data){
+                PCRE2_SIZE* ovector=pcre2_get_ovector_pointer(match_data);
+                MatchBounds m(ovector[0],ovector[1]);
+                if(known && (k=findMatch(*known,m))<known->size()) return false;
+                piece.bounds.push_back(m);
+                if(vec_num){
+                    MapNum num_map0;
+                    rm.getNumberedSubstrings(rc,s,ovector,num_map0);
+                    piece.num.push_back(num_map0);
+                }
+                if(vec_span){
+                    piece.span.push_back(SpanNum());
+                    rm.getSpans(match_data,piece.span.back());
+                }
+                return true;
+            });
+            return k;
+        };
+        
+        runTasks(ntasks,nthreads,[&](Uint,Uint t){
+            match(t,pieces[t].first,done[t],nullptr);
+        });
+        joinPieces(done,pieces,subject.data(),[&](Uint t,PCRE2_SIZE from,PieceMatches& redo){
+            return match(t,from,redo,&done[t].bounds);
+        });
+        
+        Uint total=0;
+        for(Uint t=0;t<ntasks;t++) total+=done[t].bounds.size();
+        if(vec_num){
+            vec_num->reserve(total);
+            for(Uint t=0;t<ntasks;t++) std::move(done[t].num.begin(),done[t].num.end(),std::back_inserter(*vec_num));
+        }
+        if(vec_span){
+            vec_span->reserve(total);
+            for(Uint t=0;t<ntasks;t++) std::move(done[t].span.begin(),done[t].span.end(),std::back_inserter(*vec_span));
+        }
+        return total;
+    }
+    
+    void jpcre2::Regex::replaceParallel(const std::vector<String>& subjects,std::vector<String>& results,const String& repl,
+                                        const String& mod,Uint threads) const{
+        Uint n=subjects.size();
+        Uint nthreads=batchSize(subjects)<MIN_PIECE_SIZE ? 1 : threadCount(threads);
+        Uint ntasks=std::min(n,nthreads*TASKS_PER_THREAD);
+        
+        results.resize(n);
+        
+        runTasks(ntasks,nthreads,[&](Uint,Uint t){
+            RegexReplace rr(*this);
+            rr.replaceWith(repl).modifiers(mod);
+            for(Uint i=n*t/ntasks;i<n*(t+1)/ntasks;i++) rr.subject(&subjects[i]).execute(results[i]);
+        });
+    }
+    
+    jpcre2::String jpcre2::Regex::replaceParallel(const String& subject,const String& repl,const String& mod,
+                                                  Uint threads) const{
+        Uint nthreads=threadCount(threads);
+        std::vector<std::pair<Uint,Uint> > pieces;
+        
+        ///Replacements are expanded match by match, which PCRE2 older than 10.38 can't do
+        #ifdef PCRE2_SUBSTITUTE_MATCHED
+        if(isSplittable(mod,all_opts)) splitLines(subject,nthreads,pieces);
+        #endif
+        
+        PCRE2_SPTR s=(PCRE2_SPTR)subject.data();
+        PCRE2_SIZE length=subject.size();
+        bool cut=pieces.size()>1;
+        if(cut){
+            checkUtf(s,length,all_opts);
+            cut=prefilter(s,length,PCRE2_NO_UTF_CHECK);
+        }
+        if(!cut){
+            String result;
+            RegexReplace rr(*this);
+            rr.subject(&subject).replaceWith(repl).modifiers(mod).execute(result);
+            return result;
+        }
+        
+        #ifdef PCRE2_SUBSTITUTE_MATCHED
+        Regex limited;
+        limited.allocator(user_allocator);
+        limited.compileRegex(pat_str,modifier,mylocale,jpcre2_compile_opts,compile_opts | PCRE2_USE_OFFSET_LIMIT);
+        
+        Uint ntasks=pieces.size();
+        std::vector<PieceReplaced> done(ntasks);
+        
+        ///Replaces in piece t from offset from, see match in matchParallel()
+        auto replace=[&](Uint t,PCRE2_SIZE from,PieceReplaced& piece,const std::vector<MatchBounds>* known)->size_t{
+            size_t k=known?known->size():0;
+            bool synced=false;
+            RegexReplace rr(*this);
+            rr.parseReplacementOpts(mod);
+            String expanded;
+            RegexReplace::ReplacementParts parts;
+            rr.splitReplacement(repl,parts);
+            
+            ///Only the matching is global, each match is replaced on its own
+            RegexMatch rm(*this);
+            rm.range_re=&limited;
+            PCRE2_SIZE end=pieces[t].first+pieces[t].second;
+            piece.copied=from;
+            rm.findAll().scanRange(s,length,from,end,[&](int,pcre2_match_data* match_data){
+                PCRE2_SIZE* ovector=pcre2_get_ovector_pointer(match_data);
+                MatchBounds m(ovector[0],ovector[1]);
+                if(known && (k=findMatch(*known,m))<known->size()){
+                    synced=true;
+                    return false;
+                }
+                ///\K in a lookaround may give a match that doesn't move forward, pcre2_substitute() refuses it too
+                if(ovector[0]<piece.copied) throw((int)PCRE2_ERROR_BADSUBSPATTERN);
+                piece.out.append(subject,piece.copied,ovector[0]-piece.copied);
+                piece.bounds.push_back(m);
+                piece.at.push_back(piece.out.size());
+                piece.out.append(expanded.data(),rr.expandMatch(s,length,match_data,repl,parts,expanded));
+                piece.copied=ovector[1];
+                return true;
+            });
+            ///The rest of the piece, unless it's that of the first pass
+            if(!synced && piece.copied<end){
+                piece.out.append(subject,piece.copied,end-piece.copied);
+                piece.copied=end;
+            }
+            return k;
+        };
+        
+        runTasks(ntasks,nthreads,[&](Uint,Uint t){
+            replace(t,pieces[t].first,done[t],nullptr);
+        });
+        joinPieces(done,pieces,subject.data(),[&](Uint t,PCRE2_SIZE from,PieceReplaced& redo){
+            return replace(t,from,redo,&done[t].bounds);
+        });
+        
+        Uint size=0;
+        for(size_t t=0;t<done.size();t++) size+=done[t].out.size();
+        String result;
+        result.reserve(size);
+        for(size_t t=0;t<done.size();t++) result+=done[t].out;
+        return result;
+        #else
+        return String();        ///not reached, the subject isn't cut
+        #endif
+    }
@@ -44,6 +44,27 @@ Dsclaimer:
     
     
         
+    void jpcre2::RegexReplace::setError(int err_code,PCRE2_SIZE err_offset){
+        error_code=err_code;
+        error_offset=err_offset;
+        if(err_re){err_re->error_code=err_code;err_re->error_offset=err_offset;}
+    }
+    
+    void jpcre2::RegexReplace::setModifierError(int c){
+        error_code=jpcre2_error_offset=c;
+        if(err_re) err_re->error_code=err_re->jpcre2_error_offset=c;
+    }
+    
+    void jpcre2::RegexReplace::setFileError(int errnum){
+        error_code=ERROR::FILE_ERROR;
+        jpcre2_error_offset=errnum;
+        if(err_re){err_re->error_code=ERROR::FILE_ERROR;err_re->jpcre2_error_offset=errnum;}
+    }
+    
+    jpcre2::String jpcre2::RegexReplace::getErrorMessage(int err_num){
+        return Regex::errorMessage(err_num,jpcre2_error_offset,error_offset);
+    }
+    
     void jpcre2::RegexReplace::parseReplacementOpts(const String& mod){
         replace_opts |= PCRE2_SUBSTITUTE_OVERFLOW_LENGTH; ///This enables returning the required length of string
         ///in case substitute fails due to insufficient memory. It is required to try again with the correct amount of
@@ -57,14 +78,14 @@ Dsclaimer:
                 case 'g': replace_opts  |= PCRE2_SUBSTITUTE_GLOBAL;break;
                 case 'x': replace_opts  |= PCRE2_SUBSTITUTE_EXTENDED;break;
                 default : if((jpcre2_replace_opts & VALIDATE_MODIFIER)!=0)
-                          {re->error_code=re->jpcre2_error_offset=(int)mod[i];throw((int)ERROR::INVALID_MODIFIER);}break;
+                          {setModifierError((int)mod[i]);throw((int)ERROR::INVALID_MODIFIER);}break;
             }
         }
     }
     
     
-    jpcre2::String jpcre2::RegexReplace::replace( String mains, String repl,const String& mod,
-                                    PCRE2_SIZE out_size,uint32_t opt_bits, uint32_t pcre2_opts){
+    void jpcre2::RegexReplace::replace(PCRE2_SPTR subject,PCRE2_SIZE subject_length,const String& repl,const String& mod,
+                                    PCRE2_SIZE out_size,uint32_t opt_bits,uint32_t pcre2_opts,String& result){
         
         ///populate some class vars
         ///Add PCRE2 options to replace_opts
@@ -74,15 +95,36 @@ Dsclaimer:
         
         ///Make additions to replace_opts
         parseReplacementOpts(mod);
+        limits.prepare(mcontext,re->gcontext);
+        re->ensureJit();
         
-        PCRE2_SPTR subject = (PCRE2_SPTR)mains.c_str();
-        PCRE2_SIZE subject_length = strlen((char *)subject);
-        PCRE2_SPTR replace = (PCRE2_SPTR)repl.c_str();
-        PCRE2_SIZE replace_length = strlen((char *)replace);
-        PCRE2_SIZE outlengthptr=(PCRE2_SIZE)out_size;
+        ///Nothing gets replaced in a subject without the required literal of the pattern
+        if(!re->prefilter(subject,subject_length,replace_opts)){
+            setError(0,0);
+            #ifdef PCRE2_SUBSTITUTE_REPLACEMENT_ONLY
+            if(replace_opts & PCRE2_SUBSTITUTE_REPLACEMENT_ONLY){result.clear();return;}
+            #endif
+            result.assign((const char*)subject,subject_length);
+            return;
+        }
+        
+        PCRE2_SPTR replace = (PCRE2_SPTR)repl.data();
+        PCRE2_SIZE replace_length = repl.size();
+        
+        ///Without a size hint, guess the output length from the input lengths.
+        ///A short guess costs one more pcre2_substitute() call, never a failure:
+        ///PCRE2_SUBSTITUTE_OVERFLOW_LENGTH makes it report the exact length required.
+        if(!out_size) out_size = subject_length + subject_length/2 + replace_length + 1;
+        PCRE2_SIZE outlengthptr=out_size;
         int ret=0,try_count=0;
-        PCRE2_UCHAR* output_buffer;
-        output_buffer=(PCRE2_UCHAR*)malloc(outlengthptr * sizeof(PCRE2_UCHAR));
+        
+        ///pcre2_substitute() writes straight into the result string, all of its capacity is used.
+        ///Growing a string zero fills it (C++11 has no way around that), so only what it didn't
+        ///hold before is filled, and a result string reused across calls isn't filled at all.
+        if(result.capacity()<outlengthptr) result.reserve(outlengthptr);
+        result.resize(result.capacity());
+        outlengthptr=result.size();
+        uint64_t start_ns = re->stats_shards ? Regex::statsClock() : 0;
         
         loop:
         ret=pcre2_substitute(
@@ -92,27 +134,294 @@ Dsclaimer:
             0,                                 /*Offset in the subject at which to start matching*/
             replace_opts,                      /*Option bits*/
             0,                                 /*Points to a match data block, or is NULL*/
-            0,                                 /*Points to a match context, or is NULL*/
+            mcontext,                          /*Points to a match context, or is NULL*/
             replace,                           /*Points to the replacement string*/
             replace_length,                    /*Length of the replacement string*/
-            output_buffer,                     /*Points to the output buffer*/
+            (PCRE2_UCHAR*)&result[0],          /*Points to the output buffer*/
             &outlengthptr                      /*Points to the length of the output buffer*/
         );
-        re->error_code=(int)ret;
-        re->error_offset=ret;
+        setError((int)ret,ret);
+        bool retry = (replace_opts & PCRE2_SUBSTITUTE_OVERFLOW_LENGTH) !=0 && ret == (int)PCRE2_ERROR_NOMEMORY && try_count<1;
+        ///The whole pcre2_substitute() (retry included) counts as one call
+        if(re->stats_shards && !retry)
+            re->recordMatch(ret>0 ? 0 : ret==0 ? PCRE2_ERROR_NOMATCH : ret,subject_length,
+                            re->jit_compiled && (replace_opts & PCRE2_NO_JIT)==0,start_ns);
         
         if (ret < 0){
             ///Handle errors
-            if((replace_opts & PCRE2_SUBSTITUTE_OVERFLOW_LENGTH) !=0 && ret == (int)PCRE2_ERROR_NOMEMORY && try_count<1){
+            if(retry){
                 /// Second retry in case output buffer was not big enough
-                outlengthptr++;  /// It was changed to required length
-                output_buffer=(PCRE2_UCHAR*)realloc(output_buffer,outlengthptr * sizeof(PCRE2_UCHAR));
+                /// outlengthptr was changed to the required length (including the terminating zero)
+                try_count++;
+                result.reserve(outlengthptr);
+                result.resize(result.capacity());
+                outlengthptr=result.size();
                 
                 goto loop;
             }
-            else {::free(output_buffer);throw(ret);}
+            else if(limits.hit(ret)){
+                ///pcre2_substitute() gives nothing of a failed replace, so no match is replaced
+                setError(limits.error,0);
+                result.assign((const char*)subject,subject_length);
+                return;
+            }
+            else {result.clear();throw(ret);}
+        }
+        ///outlengthptr is the length of the output, excluding the terminating zero
+        result.resize(outlengthptr);
+    }
+    
+    jpcre2::Uint jpcre2::RegexReplace::replaceTo(PCRE2_SPTR subject,PCRE2_SIZE subject_length,const String& repl,
+                                    const String& mod,uint32_t opt_bits,uint32_t pcre2_opts,const ReplaceSink& sink){
+        
+        replace_opts |= pcre2_opts;
+        jpcre2_replace_opts |= opt_bits;
+        parseReplacementOpts(mod);
+        limits.prepare(mcontext,re->gcontext);
+        re->ensureJit();
+        
+        ///Nothing gets replaced in a subject without the required literal of the pattern
+        if(!re->prefilter(subject,subject_length,replace_opts)){
+            setError(0,0);
+            #ifdef PCRE2_SUBSTITUTE_REPLACEMENT_ONLY
+            if(replace_opts & PCRE2_SUBSTITUTE_REPLACEMENT_ONLY) return 0;
+            #endif
+            sink((const char*)subject,subject_length);
+            return 0;
+        }
+        
+        if(r_evaluator){
+            const char* s=(const char*)subject;
+            const NameTable* names=&re->name_table;
+            return walkMatches(subject,subject_length,sink,[&](pcre2_match_data* match_data){
+                MatchView view(s,0,pcre2_get_ovector_pointer(match_data),pcre2_get_ovector_count(match_data),names);
+                String r=r_evaluator(view);
+                sink(r.data(),r.size());
+            });
+        }
+        
+        #ifndef PCRE2_SUBSTITUTE_MATCHED
+        ///PCRE2 older than 10.38 can't expand the replacement of a given match,
+        ///so the result is made by pcre2_substitute() as a whole and then passed on.
+        String result;
+        replace(subject,subject_length,repl,"",buffer_size,0,0,result);
+        sink(result.data(),result.size());
+        return (Uint)error_code;
+        #else
+        
+        ///The replacement of each match is expanded from the match data
+        String expanded;
+        ReplacementParts parts;
+        splitReplacement(repl,parts);
+        
+        return walkMatches(subject,subject_length,sink,[&](pcre2_match_data* match_data){
+            PCRE2_SIZE length=expandMatch(subject,subject_length,match_data,repl,parts,expanded);
+            sink(expanded.data(),length);
+        });
+        #endif
+    }
+    
+    #ifdef PCRE2_SUBSTITUTE_MATCHED
+    static bool isWordChar(char c){
+        return (c>='a' && c<='z') || (c>='A' && c<='Z') || (c>='0' && c<='9') || c=='_';
+    }
+    
+    void jpcre2::RegexReplace::splitReplacement(const String& repl,ReplacementParts& parts){
+        parts.clear();
+        if(replace_opts & PCRE2_SUBSTITUTE_EXTENDED) return;
+        uint32_t top_group=0;
+        (void)pcre2_pattern_info(re->code,PCRE2_INFO_CAPTURECOUNT,&top_group);
+        
+        ///Anything this doesn't take the same way as pcre2_substitute() (errors, $*MARK, names with
+        ///characters that are word characters only in the locale) leaves the whole of it to pcre2_substitute().
+        PCRE2_SIZE n=repl.size(),text=0,i=0;
+        while(i<n){
+            if(repl[i]!='$'){i++;continue;}
+            if(i+1>=n) {parts.clear();return;}
+            ReplacementPart part;
+            part.start=text;
+            part.length=i-text;
+            part.group=ReplacementPart::NO_GROUP;
+            PCRE2_SIZE j=i+1;
+            bool brace=repl[j]=='{';
+            if(brace) j++;
+            if(!brace && repl[j]=='$'){
+                ///$$ is a $, kept as the last character of the text
+                part.length++;
+                j++;
+            }
+            else if(j<n && repl[j]>='0' && repl[j]<='9'){
+                uint32_t group=0;
+                for(;j<n && repl[j]>='0' && repl[j]<='9';j++){
+                    group=group*10+(repl[j]-'0');
+                    if(group>top_group) {parts.clear();return;}
+                }
+                part.group=group;
+            }
+            else{
+                PCRE2_SIZE name_start=j;
+                while(j<n && isWordChar(repl[j])) j++;
+                if(j==name_start || (j<n && (unsigned char)repl[j]>=0x80)) {parts.clear();return;}
+                int group=pcre2_substring_number_from_name(re->code,(PCRE2_SPTR)repl.substr(name_start,j-name_start).c_str());
+                if(group<0) {parts.clear();return;}
+                part.group=(uint32_t)group;
+            }
+            if(brace){
+                if(j>=n || repl[j]!='}') {parts.clear();return;}
+                j++;
+            }
+            parts.push_back(part);
+            text=i=j;
+        }
+        ///The text after the last group, always there so that parts isn't empty
+        ReplacementPart last;
+        last.start=text;
+        last.length=n-text;
+        last.group=ReplacementPart::NO_GROUP;
+        parts.push_back(last);
+    }
+    
+    PCRE2_SIZE jpcre2::RegexReplace::expandMatch(PCRE2_SPTR subject,PCRE2_SIZE subject_length,pcre2_match_data* match_data,
+                                                 const String& repl,const ReplacementParts& parts,String& buffer){
+        if(!parts.empty()){
+            PCRE2_SIZE* ovector=pcre2_get_ovector_pointer(match_data);
+            uint32_t pairs=pcre2_get_ovector_count(match_data);
+            PCRE2_SIZE length=0;
+            size_t k=0;
+            for(;k<parts.size();k++){
+                uint32_t g=parts[k].group;
+                length+=parts[k].length;
+                if(g==ReplacementPart::NO_GROUP) continue;
+                ///Unset groups are an error or empty, as the options say, which pcre2_substitute() sorts out
+                if(g>=pairs || ovector[2*g]==PCRE2_UNSET) break;
+                length+=ovector[2*g+1]-ovector[2*g];
+            }
+            if(k==parts.size()){
+                if(buffer.size()<length) buffer.resize(length);
+                char* out=&buffer[0];
+                for(size_t i=0;i<parts.size();i++){
+                    uint32_t g=parts[i].group;
+                    std::memcpy(out,repl.data()+parts[i].start,parts[i].length);
+                    out+=parts[i].length;
+                    if(g==ReplacementPart::NO_GROUP) continue;
+                    std::memcpy(out,subject+ovector[2*g],ovector[2*g+1]-ovector[2*g]);
+                    out+=ovector[2*g+1]-ovector[2*g];
+                }
+                return length;
+            }
+        }
+        
+        uint32_t expand_opts = (replace_opts & (PCRE2_SUBSTITUTE_EXTENDED | PCRE2_SUBSTITUTE_UNSET_EMPTY |
+                                                PCRE2_SUBSTITUTE_UNKNOWN_UNSET)) |
+                               PCRE2_SUBSTITUTE_MATCHED | PCRE2_SUBSTITUTE_REPLACEMENT_ONLY | PCRE2_SUBSTITUTE_OVERFLOW_LENGTH |
+                               PCRE2_NO_UTF_CHECK;      ///the match has checked the subject already
+        if(buffer.empty()) buffer.resize(repl.size()+64);
+        PCRE2_SIZE out_length=buffer.size();
+        int ret=pcre2_substitute(re->code,subject,subject_length,0,expand_opts,match_data,NULL,
+                                 (PCRE2_SPTR)repl.data(),repl.size(),(PCRE2_UCHAR*)&buffer[0],&out_length);
+        if(ret==PCRE2_ERROR_NOMEMORY){
+            ///out_length is the size needed, terminating zero included
+            buffer.resize(out_length);
+            ret=pcre2_substitute(re->code,subject,subject_length,0,expand_opts,match_data,NULL,
+                                 (PCRE2_SPTR)repl.data(),repl.size(),(PCRE2_UCHAR*)&buffer[0],&out_length);
+        }
+        if(ret<0){
+            setError(ret,ret);
+            throw(ret);
+        }
+        return out_length;
+    }
+    #endif
+    
+    int jpcre2::RegexReplace::exec(PCRE2_SPTR subject,PCRE2_SIZE length,PCRE2_SIZE start_offset,uint32_t options,
+                                                                                    pcre2_match_data* match_data){
+        ///Out of time, limits.hit() takes it from limits.error
+        if(limits.deadline && limits.expired()) return PCRE2_ERROR_MATCHLIMIT;
+        bool jit_fallback=false;
+        return re->exec(re,subject,length,start_offset,options,match_data,mcontext,jit_fallback);
+    }
+    
+    jpcre2::Uint jpcre2::RegexReplace::walkMatches(PCRE2_SPTR subject,PCRE2_SIZE subject_length,const ReplaceSink& sink,
+                                    const std::function<void(pcre2_match_data*)>& replace_match){
+        
+        const char* s=(const char*)subject;
+        
+        #ifdef PCRE2_SUBSTITUTE_REPLACEMENT_ONLY
+        bool replacement_only=(replace_opts & PCRE2_SUBSTITUTE_REPLACEMENT_ONLY)!=0;
+        #else
+        bool replacement_only=false;
+        #endif
+        
+        ///The match options among the replace options go to pcre2_match()
+        uint32_t match_opts = replace_opts & (PCRE2_ANCHORED | PCRE2_NOTBOL | PCRE2_NOTEOL | PCRE2_NOTEMPTY |
+                                              PCRE2_NOTEMPTY_ATSTART | PCRE2_NO_UTF_CHECK | PCRE2_NO_JIT);
+        #ifdef PCRE2_ENDANCHORED
+        match_opts |= replace_opts & PCRE2_ENDANCHORED;
+        #endif
+        bool global = (replace_opts & PCRE2_SUBSTITUTE_GLOBAL)!=0;
+        bool utf = (re->all_opts & PCRE2_UTF)!=0;
+        
+        Uint count=0;
+        PCRE2_SIZE start_offset=0;      ///where the next match attempt starts
+        PCRE2_SIZE copied=0;            ///the subject up to here has been passed to sink
+        uint32_t extra_opts=0;
+        
+        pcre2_match_data *match_data = re->md_pool.checkout(re->code);
+        PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(match_data);
+        
+        try{
+            ///Same loop as pcre2_substitute() runs with PCRE2_SUBSTITUTE_GLOBAL
+            for(;;){
+                int rc=exec(subject,subject_length,start_offset,match_opts | extra_opts,match_data);
+                
+                if(rc==PCRE2_ERROR_NOMATCH){
+                    if(extra_opts==0) break;
+                    ///No non-empty match after an empty one, move on by one character
+                    extra_opts=0;
+                    start_offset++;
+                    if(re->crlf_is_newline && start_offset<subject_length &&
+                       s[start_offset-1]=='\r' && s[start_offset]=='\n') start_offset++;
+                    else if(utf){
+                        while(start_offset<subject_length && ((unsigned char)s[start_offset] & 0xc0)==0x80) start_offset++;
+                    }
+                    continue;
+                }
+                if(rc<0){
+                    ///The rest of the subject is left as it is
+                    if(limits.hit(rc)){
+                        setError(limits.error,0);
+                        break;
+                    }
+                    setError(rc,rc);
+                    throw(rc);
+                }
+                ///\K in a lookaround may give a match that doesn't move forward, pcre2_substitute() refuses it too
+                if(ovector[1]<ovector[0] || ovector[0]<start_offset){
+                    setError(PCRE2_ERROR_BADSUBSPATTERN,ovector[0]);
+                    throw((int)PCRE2_ERROR_BADSUBSPATTERN);
+                }
+                
+                if(!replacement_only && ovector[0]>copied) sink(s+copied,ovector[0]-copied);
+                replace_match(match_data);
+                count++;
+                copied=ovector[1];
+                
+                if(!global) break;
+                match_opts |= PCRE2_NO_UTF_CHECK;       ///the subject was checked by the first match
+                start_offset=ovector[1];
+                if(ovector[0]==ovector[1]){
+                    if(ovector[0]==subject_length) break;
+                    extra_opts=PCRE2_NOTEMPTY_ATSTART | PCRE2_ANCHORED;
+                }
+                else extra_opts=0;
+            }
+            if(!replacement_only && copied<subject_length) sink(s+copied,subject_length-copied);
+        }
+        catch(...){
+            re->md_pool.checkin(match_data);
+            throw;
         }
-        String result=jpcre2_utils::toString((char*)output_buffer);
-        ::free(output_buffer);
-        return result;
+        re->md_pool.checkin(match_data);
+        if(!limits.error) setError((int)count,count);
+        return count;
     }
@@ -0,0 +1,176 @@
+/***********************************************************************
+ * C++ wrapper for several utilities of PCRE2 Library
+ * ********************************************************************/
+
+/* 
+This is a public C++ wrapper for several utilities of the PCRE library, second API, to be
+#included by applications that call PCRE2 functions.
+
+           Copyright (c) 2015 Md. Jahidul Hamid
+
+-----------------------------------------------------------------------------
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * The names of its contributors may be used to endorse or promote 
+      products derived from this software without specific prior written
+      permission.
+      
+Dsclaimer:
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+    
+*/
+
+
+#include "jpcre2.h"
+    
+    
+    static inline bool hasByte(const uint64_t* bits,int c){
+        return (bits[c >> 6] >> (c & 63)) & 1;
+    }
+    
+    static inline void setByte(uint64_t* bits,int c){
+        bits[c >> 6] |= (uint64_t)1 << (c & 63);
+    }
+    
+    ///Offset of the flipped case table in the character tables made by pcre2_maketables()
+    ///(fcc_offset of pcre2_internal.h), which caseless matching goes by
+    static const int FCC_OFFSET = 256;
+    
+    ///Adds a required code unit to the filter. The case of the pattern isn't known, so the other case
+    ///of a letter will do too, as tables (those of the pattern) have it: a locale may have letters above
+    ///0x7f, or ASCII letters with a non-ASCII other case. PCRE2's built-in tables (null) have ASCII
+    ///letters only. In UTF mode, a non-ASCII unit may be the first byte of a character with other cases,
+    ///and k and s have non-ASCII other cases (KELVIN SIGN, LONG S), those are not used.
+    static void addUnit(int* unit,int* alt_unit,uint32_t c,bool utf,const unsigned char* tables){
+        if(c > 0xff) return;
+        if(utf && (c >= 0x80 || c=='k' || c=='K' || c=='s' || c=='S')) return;
+        int other = (int)c;
+        if(tables) other = tables[FCC_OFFSET + c];
+        else if(c >= 'a' && c <= 'z') other = (int)c - 'a' + 'A';
+        else if(c >= 'A' && c <= 'Z') other = (int)c - 'A' + 'a';
+        if(utf && other >= 0x80) return;        ///a character of more than one byte
+        int i = unit[0] < 0 ? 0 : 1;
+        if(unit[i] >= 0) return;
+        unit[i] = (int)c;
+        if(other != (int)c) alt_unit[i] = other;
+    }
+    
+    void jpcre2::RegexSet::buildFilter(const Regex& re,Filter& f){
+        uint32_t type=0,c=0,min_length=0;
+        const uint8_t* bitmap=nullptr;
+        bool utf=(re.all_opts & PCRE2_UTF)!=0;
+        const unsigned char* tables=re.characterTables();
+        
+        f.unit[0]=f.unit[1]=f.alt_unit[0]=f.alt_unit[1]=-1;
+        f.has_bitmap=false;
+        std::memset(f.bitmap,0,sizeof(f.bitmap));
+        
+        (void)pcre2_pattern_info(re.code, PCRE2_INFO_MINLENGTH, &min_length);
+        f.min_length=min_length;    ///in characters, each is at least one byte
+        
+        (void)pcre2_pattern_info(re.code, PCRE2_INFO_FIRSTCODETYPE, &type);
+        if(type==1){
+            (void)pcre2_pattern_info(re.code, PCRE2_INFO_FIRSTCODEUNIT, &c);
+            addUnit(f.unit,f.alt_unit,c,utf,tables);
+        }
+        else if(type==0){
+            (void)pcre2_pattern_info(re.code, PCRE2_INFO_FIRSTBITMAP, &bitmap);
+            if(bitmap){
+                f.has_bitmap=true;
+                for(int i=0;i<256;i++) if(bitmap[i/8] & (1 << (i%8))) setByte(f.bitmap,i);
+            }
+        }
+        
+        (void)pcre2_pattern_info(re.code, PCRE2_INFO_LASTCODETYPE, &type);
+        if(type==1){
+            (void)pcre2_pattern_info(re.code, PCRE2_INFO_LASTCODEUNIT, &c);
+            addUnit(f.unit,f.alt_unit,c,utf,tables);
+        }
+    }
+    
+    bool jpcre2::RegexSet::passes(const Filter& f,const uint64_t* present,PCRE2_SIZE len) const{
+        if(len < f.min_length) return false;
+        for(int i=0;i<2;i++){
+            if(f.unit[i] >= 0 && !hasByte(present,f.unit[i]) &&
+               !(f.alt_unit[i] >= 0 && hasByte(present,f.alt_unit[i]))) return false;
+        }
+        if(f.has_bitmap){
+            if(!((f.bitmap[0] & present[0]) | (f.bitmap[1] & present[1]) |
+                 (f.bitmap[2] & present[2]) | (f.bitmap[3] & present[3]))) return false;
+        }
+        return true;
+    }
+    
+    jpcre2::RegexSet& jpcre2::RegexSet::add(const String& re,const String& mod,const String& loc){
+        std::unique_ptr<Regex> r(new Regex);
+        r->compile(re,mod).locale(loc).execute();
+        
+        Filter f;
+        buildFilter(*r,f);
+        
+        Uint i=patterns.size();
+        if(f.unit[0] >= 0){
+            buckets[f.unit[0]].push_back(i);
+            if(f.alt_unit[0] >= 0) buckets[f.alt_unit[0]].push_back(i);
+        }
+        else unfiltered.push_back(i);
+        
+        patterns.push_back(std::move(r));
+        filters.push_back(f);
+        return *this;
+    }
+    
+    void jpcre2::RegexSet::clear(){
+        patterns.clear();
+        filters.clear();
+        for(int i=0;i<256;i++) buckets[i].clear();
+        unfiltered.clear();
+    }
+    
+    jpcre2::Uint jpcre2::RegexSet::match(const char* subject,Uint len,std::vector<Uint>& matched) const{
+        uint64_t present[4]={0,0,0,0};
+        const unsigned char* s=(const unsigned char*)subject;
+        
+        matched.clear();
+        for(Uint i=0;i<len;i++) setByte(present,s[i]);
+        
+        ///Candidates are the patterns filed under a byte of the subject, plus those that can't be filed
+        for(int c=0;c<256;c++){
+            if(!hasByte(present,c)) continue;
+            const std::vector<Uint>& bucket=buckets[c];
+            for(size_t j=0;j<bucket.size();j++) if(passes(filters[bucket[j]],present,len)) matched.push_back(bucket[j]);
+        }
+        for(size_t j=0;j<unfiltered.size();j++) if(passes(filters[unfiltered[j]],present,len)) matched.push_back(unfiltered[j]);
+        
+        ///A caseless pattern is filed under both cases
+        std::sort(matched.begin(),matched.end());
+        matched.erase(std::unique(matched.begin(),matched.end()),matched.end());
+        
+        ///Only the candidates are matched for real, with a pooled block and nothing extracted
+        Uint count=0;
+        for(size_t j=0;j<matched.size();j++){
+            RegexMatch rm(*patterns[matched[j]]);
+            if(rm.subject(subject,len).test()) matched[count++]=matched[j];
+        }
+        matched.resize(count);
+        return count;
+    }
@@ -0,0 +1,534 @@
+/***********************************************************************
+ * C++ wrapper for several utilities of PCRE2 Library
+ * ********************************************************************/
+
+/* 
+This is a public C++ wrapper for several utilities of the PCRE library, second API, to be
+#included by applications that call PCRE2 functions.
+
+           Copyright (c) 2015 Md. Jahidul Hamid
+
+-----------------------------------------------------------------------------
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    * The names of its contributors may be used to endorse or promote 
+      products derived from this software without specific prior written
+      permission.
+      
+Dsclaimer:
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+    
+*/
+
+
+#include "jpcre2.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define JPCRE2_USE_MMAP 1
+#else
+#include <io.h>
+#endif
+#include <cerrno>
+#include <fstream>
+    
+    
+    ///Number of bytes at the end of buf that belong to an unfinished UTF-8 character
+    static PCRE2_SIZE incompleteTail(const jpcre2::String& buf){
+        PCRE2_SIZE n=buf.size();
+        for(PCRE2_SIZE k=1;k<=4 && k<=n;k++){
+            unsigned char c=buf[n-k];
+            if((c & 0xc0)==0x80) continue;          ///continuation byte, look further back
+            PCRE2_SIZE need = c>=0xf0 ? 4 : c>=0xe0 ? 3 : c>=0xc0 ? 2 : 1;
+            return need>k ? k : 0;
+        }
+        return 0;
+    }
+    
+    jpcre2::Uint jpcre2::RegexMatch::executeStream(const StreamReader& reader,const MatchCallback& callback){
+        
+        Uint count=0;
+        
+        prepare(m_modifier,jpcre2_match_opts,match_opts);
+        
+        uint32_t base_opts = match_opts & ~(PCRE2_PARTIAL_HARD | PCRE2_PARTIAL_SOFT);
+        bool utf = (re->all_opts & PCRE2_UTF) != 0;
+        
+        ///Input kept before the next match attempt, so lookbehinds (\b included) can see it.
+        ///MAXLOOKBEHIND is in characters, a UTF-8 character takes up to 4 bytes.
+        uint32_t max_lookbehind=0;
+        (void)pcre2_pattern_info(re->code, PCRE2_INFO_MAXLOOKBEHIND, &max_lookbehind);
+        PCRE2_SIZE keep = (PCRE2_SIZE)max_lookbehind*(utf?4:1) + 1;
+        
+        String buf;                     ///window of the input
+        PCRE2_SIZE buf_offset=0;        ///offset of buf[0] in the input
+        PCRE2_SIZE visible=0;           ///buf without an unfinished UTF-8 character at its end
+        PCRE2_SIZE pos=0;               ///where the next match attempt starts in buf
+        bool eof=false;
+        bool need_data=true;
+        bool utf_checked=false;         ///the part of buf after pos is known to be valid UTF
+        bool retry_nonempty=false;      ///the last match was empty and ended at pos
+        
+        pcre2_match_data *match_data = re->md_pool.checkout(re->code);
+        PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(match_data);
+        Uint groups = pcre2_get_ovector_count(match_data);
+        
+        try{
+            for(;;){
+                if(need_data && !eof){
+                    ///Drop what no match attempt can look at any more
+                    PCRE2_SIZE drop = pos>keep ? pos-keep : 0;
+                    if(drop){
+                        buf.erase(0,drop);
+                        buf_offset+=drop;
+                        pos-=drop;
+                    }
+                    PCRE2_SIZE old_size=buf.size();
+                    buf.resize(old_size+chunk_size);
+                    Uint got=reader(&buf[old_size],chunk_size);
+                    buf.resize(old_size+got);
+                    if(!got) eof=true;
+                    
+                    visible=buf.size();
+                    if(utf && !eof) visible-=incompleteTail(buf);
+                    need_data=false;
+                    utf_checked=false;
+                }
+                
+                uint32_t options = base_opts;
+                if(!eof) options |= PCRE2_PARTIAL_HARD;         ///there's more input to come
+                if(buf_offset) options |= PCRE2_NOTBOL;         ///buf doesn't start at the start of the input
+                if(retry_nonempty) options |= PCRE2_NOTEMPTY_ATSTART | PCRE2_ANCHORED;
+                if(utf_checked) options |= PCRE2_NO_UTF_CHECK;
+                
+                int rc = exec((PCRE2_SPTR)buf.data(),visible,pos,options,match_data);
+                
+                if(rc == PCRE2_ERROR_PARTIAL){
+                    ///A match may start at ovector[0], nothing before it can. Complete it with more input.
+                    if(!retry_nonempty) pos=ovector[0];
+                    need_data=true;
+                    continue;
+                }
+                utf_checked = rc>=0 || rc==PCRE2_ERROR_NOMATCH;
+                
+                if(rc == PCRE2_ERROR_NOMATCH){
+                    if(!retry_nonempty){
+                        ///Partial matches are reported, so no match can start before the end of buf
+                        if(eof) break;
+                        pos=visible;
+                        need_data=true;
+                        continue;
+                    }
+                    
+                    /* No non-empty match where the previous empty match was: advance by one
+                    character, as the global match loop does (see RegexMatch::scan()). Make
+                    sure the next character and the one after are there first. */
+                    
+                    if(!eof && pos+2>visible){need_data=true;continue;}
+                    retry_nonempty=false;
+                    pos+=1;
+                    if(re->crlf_is_newline && pos<visible && buf[pos-1]=='\r' && buf[pos]=='\n') pos+=1;
+                    else if(utf){
+                        while(pos<visible && ((unsigned char)buf[pos] & 0xc0)==0x80) pos+=1;
+                    }
+                    continue;
+                }
+                
+                if(rc < 0){
+                    if(stopAtLimit(rc)) break;
+                    setError(rc,rc);
+                    throw(rc);
+                }
+                if(rc == 0) break;     ///ovector too small, can't happen with a block from the pattern
+                
+                count++;
+                MatchView view(buf.data(),buf_offset,ovector,groups,&re->name_table);
+                if(!callback(view) || (jpcre2_match_opts & FIND_ALL)==0) break;
+                
+                retry_nonempty = ovector[0]==ovector[1];
+                pos=ovector[1];
+                if(retry_nonempty && eof && pos==visible) break;
+            }
+        }
+        catch(...){
+            re->md_pool.checkin(match_data);
+            throw;
+        }
+        re->md_pool.checkin(match_data);
+        return count;
+    }
+    
+    jpcre2::Uint jpcre2::RegexMatch::executeStream(std::istream& in,const MatchCallback& callback){
+        return executeStream([&in](char* buffer,Uint size)->Uint{
+            in.read(buffer,size);
+            return (Uint)in.gcount();
+        },callback);
+    }
+    
+    
+    ///A file mapped read-only for the lifetime of the object.
+    ///Where mmap() isn't available the file is read into memory instead.
+    struct MappedFile{
+        const char* data;
+        size_t size;
+        int error;                  ///errno of a failure, 0 if data is valid
+        #ifdef JPCRE2_USE_MMAP
+        void* map;
+        #else
+        jpcre2::String copy;
+        #endif
+        
+        explicit MappedFile(const jpcre2::String& path){
+            data="";
+            size=0;
+            error=0;
+            #ifdef JPCRE2_USE_MMAP
+            map=MAP_FAILED;
+            int fd=::open(path.c_str(),O_RDONLY);
+            if(fd<0){error=errno;return;}
+            struct stat st;
+            if(::fstat(fd,&st)!=0){error=errno;::close(fd);return;}
+            if(st.st_size>0){
+                map=::mmap(NULL,(size_t)st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+                if(map==MAP_FAILED) error=errno;
+                else{
+                    data=(const char*)map;
+                    size=(size_t)st.st_size;
+                    ///Matching reads the file front to back
+                    (void)::madvise(map,size,MADV_SEQUENTIAL);
+                }
+            }
+            ::close(fd);        ///the mapping stays valid
+            #else
+            std::ifstream in(path.c_str(),std::ios::binary);
+            if(!in){error=errno?errno:ENOENT;return;}
+            copy.assign(std::istreambuf_iterator<char>(in),std::istreambuf_iterator<char>());
+            data=copy.data();
+            size=copy.size();
+            #endif
+        }
+        
+        ~MappedFile(){
+            #ifdef JPCRE2_USE_MMAP
+            if(map!=MAP_FAILED) ::munmap(map,size);
+            #endif
+        }
+    };
+    
+    ///Gathers small pieces of output and writes them to a file descriptor in big blocks.
+    ///A failed write throws ERROR::FILE_ERROR with errno in error.
+    struct FdWriter{
+        int fd;
+        int error;
+        jpcre2::String buf;
+        
+        static const size_t BLOCK = 65536;
+        
+        explicit FdWriter(int f){fd=f;error=0;buf.reserve(BLOCK);}
+        
+        void write(const char* data,size_t size){
+            while(size){
+                #ifdef JPCRE2_USE_MMAP
+                ssize_t n=::write(fd,data,size);
+                #else
+                int n=::_write(fd,data,(unsigned int)size);
+                #endif
+                if(n<0){
+                    if(errno==EINTR) continue;
+                    error=errno;
+                    throw((int)jpcre2::ERROR::FILE_ERROR);
+                }
+                data+=n;
+                size-=(size_t)n;
+            }
+        }
+        
+        void put(const char* data,size_t size){
+            if(buf.size()+size>BLOCK){
+                flush();
+                if(size>=BLOCK){write(data,size);return;}
+            }
+            buf.append(data,size);
+        }
+        
+        void flush(){
+            write(buf.data(),buf.size());
+            buf.clear();
+        }
+    };
+    
+    jpcre2::Uint jpcre2::RegexMatch::executeFile(const String& path){
+        MappedFile file(path);
+        if(file.error){
+            setFileError(file.error);
+            throw((int)ERROR::FILE_ERROR);
+        }
+        return match((PCRE2_SPTR)file.data,file.size,m_modifier,jpcre2_match_opts,match_opts);
+    }
+    
+    jpcre2::Uint jpcre2::RegexReplace::replaceToFd(PCRE2_SPTR subject,PCRE2_SIZE subject_length,int fd){
+        FdWriter out(fd);
+        Uint count;
+        try{
+            count=replaceTo(subject,subject_length,r_replw,r_modifier,jpcre2_replace_opts,replace_opts,
+                            [&out](const char* data,Uint size){out.put(data,size);});
+            out.flush();
+        }
+        catch(int e){
+            if(e==ERROR::FILE_ERROR) setFileError(out.error);
+            throw;
+        }
+        return count;
+    }
+    
+    jpcre2::Uint jpcre2::RegexReplace::executeFd(int fd){
+        PCRE2_SPTR s=(PCRE2_SPTR)(p_subject?p_subject:r_subject.data());
+        PCRE2_SIZE len=p_subject?p_subject_len:r_subject.size();
+        return replaceToFd(s,len,fd);
+    }
+    
+    jpcre2::Uint jpcre2::RegexReplace::execute(std::ostream& out){
+        return execute([&out](const char* data,Uint size){out.write(data,(std::streamsize)size);});
+    }
+    
+    jpcre2::Uint jpcre2::RegexReplace::executeFile(const String& path,int fd){
+        MappedFile file(path);
+        if(file.error){
+            setFileError(file.error);
+            throw((int)ERROR::FILE_ERROR);
+        }
+        return replaceToFd((PCRE2_SPTR)file.data,file.size,fd);
+    }
+    
+    
+    /* Layout of a file written by RegexArchive::save(), numbers in the byte order of the machine:
+    
+        "JPCRE2AR" | u32 format version | u32 0x01020304 | u32 number of patterns | u32 number of blocks
+        for each pattern:   u32 block | u32 index in block | u32 jpcre2 options | u32 compile options |
+                            pattern | modifiers | locale        (strings as u64 length + bytes)
+        for each block:     u64 length | pcre2_serialize_encode() output
+    
+    pcre2_serialize_decode() copies a block, so it needs no alignment. */
+    
+    static const char ARCHIVE_MAGIC[8]={'J','P','C','R','E','2','A','R'};
+    static const uint32_t ARCHIVE_VERSION=1;
+    static const uint32_t ARCHIVE_BYTE_ORDER=0x01020304;
+    
+    ///Builds the file in memory
+    struct ArchiveWriter{
+        jpcre2::String out;
+        
+        void bytes(const void* p,size_t n)      {out.append((const char*)p,n);}
+        void u32(uint32_t x)                    {bytes(&x,sizeof(x));}
+        void u64(uint64_t x)                    {bytes(&x,sizeof(x));}
+        void str(const jpcre2::String& s)       {u64(s.size());bytes(s.data(),s.size());}
+    };
+    
+    ///Reads the mapped file, any read past its end throws PCRE2_ERROR_BADSERIALIZEDDATA
+    struct ArchiveReader{
+        const char* p;
+        const char* end;
+        
+        ArchiveReader(const char* data,size_t size){p=data;end=data+size;}
+        
+        const char* bytes(uint64_t n){
+            if(n>(uint64_t)(end-p)) throw((int)PCRE2_ERROR_BADSERIALIZEDDATA);
+            const char* r=p;
+            p+=n;
+            return r;
+        }
+        uint32_t u32()                          {uint32_t x;std::memcpy(&x,bytes(sizeof(x)),sizeof(x));return x;}
+        uint64_t u64()                          {uint64_t x;std::memcpy(&x,bytes(sizeof(x)),sizeof(x));return x;}
+        jpcre2::String str()                    {uint64_t n=u64();const char* s=bytes(n);return jpcre2::String(s,n);}
+    };
+    
+    ///What is saved of each Regex besides its code
+    struct ArchiveEntry{
+        uint32_t block,index,jpcre2_opts,compile_opts;
+        jpcre2::String pattern,modifier,locale;
+    };
+    
+    jpcre2::String jpcre2::RegexArchive::getErrorMessage(int err_num){
+        return Regex::errorMessage(err_num,error_errno,0);
+    }
+    
+    void jpcre2::RegexArchive::save(const String& path){
+        error_code=0;
+        error_errno=0;
+        
+        ///pcre2_serialize_encode() wants the same tables for all codes of a block: the patterns compiled
+        ///in a locale share one, and those loaded from one block keep sharing the tables it was decoded with
+        typedef std::pair<String,const void*> TablesKey;
+        std::vector<TablesKey> tables;
+        std::vector<std::vector<const pcre2_code*> > blocks;
+        std::vector<ArchiveEntry> entries(regexes.size());
+        for(Uint i=0;i<regexes.size();i++){
+            const Regex* re=regexes[i];
+            if(!re->code){
+                error_code=PCRE2_ERROR_NULL;
+                throw((int)PCRE2_ERROR_NULL);
+            }
+            TablesKey key(re->mylocale,re->loaded_tables.get());
+            Uint b=std::find(tables.begin(),tables.end(),key)-tables.begin();
+            if(b==tables.size()){
+                tables.push_back(key);
+                blocks.push_back(std::vector<const pcre2_code*>());
+            }
+            ArchiveEntry& e=entries[i];
+            e.block=(uint32_t)b;
+            e.index=(uint32_t)blocks[b].size();
+            e.jpcre2_opts=re->jpcre2_compile_opts;
+            e.compile_opts=re->compile_opts;
+            e.pattern=re->pat_str;
+            e.modifier=re->modifier;
+            e.locale=re->mylocale;
+            blocks[b].push_back(re->code);
+        }
+        
+        ArchiveWriter w;
+        w.bytes(ARCHIVE_MAGIC,sizeof(ARCHIVE_MAGIC));
+        w.u32(ARCHIVE_VERSION);
+        w.u32(ARCHIVE_BYTE_ORDER);
+        w.u32((uint32_t)entries.size());
+        w.u32((uint32_t)blocks.size());
+        for(Uint i=0;i<entries.size();i++){
+            const ArchiveEntry& e=entries[i];
+            w.u32(e.block);
+            w.u32(e.index);
+            w.u32(e.jpcre2_opts);
+            w.u32(e.compile_opts);
+            w.str(e.pattern);
+            w.str(e.modifier);
+            w.str(e.locale);
+        }
+        for(Uint b=0;b<blocks.size();b++){
+            uint8_t* bytes=nullptr;
+            PCRE2_SIZE size=0;
+            int32_t rc=pcre2_serialize_encode(&blocks[b][0],(int32_t)blocks[b].size(),&bytes,&size,NULL);
+            if(rc<0){
+                error_code=rc;
+                throw((int)rc);
+            }
+            w.u64(size);
+            w.bytes(bytes,size);
+            pcre2_serialize_free(bytes);
+        }
+        
+        std::ofstream file(path.c_str(),std::ios::binary | std::ios::trunc);
+        if(file) file.write(w.out.data(),(std::streamsize)w.out.size());
+        if(file) file.close();
+        if(!file){
+            error_code=ERROR::FILE_ERROR;
+            error_errno=errno?errno:EIO;
+            throw((int)ERROR::FILE_ERROR);
+        }
+    }
+    
+    jpcre2::Uint jpcre2::RegexArchive::load(const String& path,std::vector<std::unique_ptr<Regex> >& loaded){
+        error_code=0;
+        error_errno=0;
+        
+        MappedFile file(path);
+        if(file.error){
+            error_code=ERROR::FILE_ERROR;
+            error_errno=file.error;
+            throw((int)ERROR::FILE_ERROR);
+        }
+        
+        try{
+            ArchiveReader r(file.data,file.size);
+            if(file.size<sizeof(ARCHIVE_MAGIC) || std::memcmp(r.bytes(sizeof(ARCHIVE_MAGIC)),ARCHIVE_MAGIC,sizeof(ARCHIVE_MAGIC))!=0)
+                throw((int)PCRE2_ERROR_BADMAGIC);
+            uint32_t version=r.u32();
+            ///Saved by a machine of the other byte order, which swapped the version too,
+            ///reported as pcre2_serialize_decode() reports it
+            if(r.u32()!=ARCHIVE_BYTE_ORDER) throw((int)PCRE2_ERROR_BADMODE);
+            if(version!=ARCHIVE_VERSION) throw((int)PCRE2_ERROR_BADMAGIC);
+            uint32_t n=r.u32();
+            uint32_t nblocks=r.u32();
+            
+            std::vector<ArchiveEntry> entries(n);
+            for(uint32_t i=0;i<n;i++){
+                ArchiveEntry& e=entries[i];
+                e.block=r.u32();
+                e.index=r.u32();
+                e.jpcre2_opts=r.u32();
+                e.compile_opts=r.u32();
+                e.pattern=r.str();
+                e.modifier=r.str();
+                e.locale=r.str();
+                if(e.block>=nblocks) throw((int)PCRE2_ERROR_BADSERIALIZEDDATA);
+            }
+            
+            ///Decoded codes are owned right away, so they are freed if a later block fails
+            std::vector<std::vector<std::shared_ptr<pcre2_code> > > blocks(nblocks);
+            std::vector<std::shared_ptr<const void> > block_tables(nblocks);
+            for(uint32_t b=0;b<nblocks;b++){
+                uint64_t size=r.u64();
+                const uint8_t* bytes=(const uint8_t*)r.bytes(size);
+                int32_t count=pcre2_serialize_get_number_of_codes(bytes);
+                if(count<0) throw((int)count);
+                if(count==0) throw((int)PCRE2_ERROR_BADSERIALIZEDDATA);
+                std::vector<pcre2_code*> codes(count);
+                int32_t rc=pcre2_serialize_decode(&codes[0],count,bytes,NULL);
+                if(rc<0) throw((int)rc);
+                for(int32_t i=0;i<rc;i++) blocks[b].push_back(std::shared_ptr<pcre2_code>(codes[i],pcre2_code_free));
+                block_tables[b]=std::make_shared<char>();
+            }
+            
+            Uint first=loaded.size();
+            try{
+                for(uint32_t i=0;i<n;i++){
+                    const ArchiveEntry& e=entries[i];
+                    if(e.index>=blocks[e.block].size()) throw((int)PCRE2_ERROR_BADSERIALIZEDDATA);
+                    std::unique_ptr<Regex> re(new Regex);
+                    ///The state compileRegex() leaves, without compiling
+                    re->parseCompileOpts(e.modifier,e.jpcre2_opts);
+                    re->compile_opts=e.compile_opts;
+                    re->jpcre2_compile_opts=e.jpcre2_opts;
+                    re->pat_str=e.pattern;
+                    re->modifier=e.modifier;
+                    re->mylocale=e.locale;
+                    re->md_pool.clear();
+                    re->code_ptr=blocks[e.block][e.index];
+                    re->loaded_tables=block_tables[e.block];
+                    re->code=re->code_ptr.get();
+                    re->error_number=re->error_code=0;
+                    re->readPatternInfo();
+                    re->jit_pending=re->opt_jit_compile;
+                    loaded.push_back(std::move(re));
+                }
+            }
+            catch(...){
+                loaded.resize(first);
+                throw;
+            }
+            return n;
+        }
+        catch(int e){
+            error_code=e;
+            throw;
+        }
+    }
@@ -0,0 +1,64 @@
+#include "test_check.h"
+#include <set>
+
+///Regex::allocator(): the pattern, its match data and MatchSet results take memory from a user Allocator,
+///and all of it goes back to it.
+
+struct CountingAllocator: jpcre2::Allocator{
+    std::set<void*> live;
+    size_t allocs,bad_frees;
+    CountingAllocator(){allocs=bad_frees=0;}
+    void* allocate(jpcre2::Uint n){
+        void* p=std::malloc(n);
+        if(p){live.insert(p);allocs++;}
+        return p;
+    }
+    void deallocate(void* p){
+        if(!live.erase(p)) {bad_frees++;return;}
+        std::free(p);
+    }
+};
+
+TEST_CASE(allocator_takes_and_returns_all){
+    CountingAllocator a;
+    std::string s="mail a@b.com and c@d.com";
+    {
+        jpcre2::Regex re;
+        re.allocator(&a).compile("(?<user>\\w+)@(\\w+)\\.com").execute();
+        CHECK(a.allocs>0);
+        size_t compiled=a.allocs;
+        
+        jpcre2::MatchSet ms(&a);
+        CHECK(re.match(s).findAll().matchSet(ms).execute()==2);
+        CHECK(ms.str(s,1,1)=="c" && ms.str(s,0,2)=="b");
+        CHECK(a.allocs>compiled);
+        CHECK(re.match(s).count()==2);
+        CHECK(re.replace(s,"<${user}>").modifiers("g").execute()=="mail <a> and <c>");
+        
+        ///Interpreted matches that need heap frames take from it too
+        jpcre2::Regex deep;
+        deep.allocator(&a).compile("(a|b)*+c").execute();
+        CHECK(deep.match(std::string(5000,'a')+"c").test());
+    }
+    CHECK(a.live.empty());
+    CHECK(a.bad_frees==0);
+}
+
+TEST_CASE(allocator_bypasses_cache){
+    CountingAllocator a;
+    jpcre2::Uint cached=jpcre2::RegexCache::size();
+    {
+        jpcre2::Regex re;
+        re.allocator(&a).compile("allocator_bypasses_cache\\d").execute();
+        CHECK(re.match("allocator_bypasses_cache7").test());
+        CHECK(jpcre2::RegexCache::size()==cached);
+        
+        ///Back to malloc(), the next compile is done without the allocator
+        size_t allocs=a.allocs;
+        re.allocator(nullptr).execute();
+        CHECK(re.match("allocator_bypasses_cache7").test());
+        CHECK(a.allocs==allocs);
+    }
+    CHECK(a.live.empty());
+    CHECK(a.bad_frees==0);
+}
@@ -0,0 +1,208 @@
+#include "test_check.h"
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <cstdlib>
+#include <unistd.h>
+
+///RegexArchive: loaded patterns match as the saved ones, and a damaged file throws without
+///touching what was loaded before.
+
+static std::string tempPath(){
+    char path[]="/tmp/jpcre2testXXXXXX";
+    int fd=mkstemp(path);
+    if(fd<0) return "";
+    close(fd);
+    return path;
+}
+
+static std::string readFile(const std::string& path){
+    std::ifstream f(path.c_str(),std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(f)),std::istreambuf_iterator<char>());
+}
+
+static void writeFile(const std::string& path,const std::string& data){
+    std::ofstream(path.c_str(),std::ios::binary | std::ios::trunc).write(data.data(),data.size());
+}
+
+static void putU32(std::string& data,size_t at,uint32_t x){
+    std::memcpy(&data[at],&x,sizeof(x));
+}
+
+///Offset of the encoded bytes of the last block: the one whose u64 length reaches the end of the file
+static size_t lastBlock(const std::string& data){
+    for(size_t p=data.size()-sizeof(uint64_t);p>0;p--){
+        uint64_t n;
+        std::memcpy(&n,&data[p],sizeof(n));
+        if(p+sizeof(n)+n==data.size()) return p+sizeof(n);
+    }
+    return 0;
+}
+
+static const char* const patterns[][2]={{"(?<y>\\d{4})-(?<m>\\d\\d)","S"},{"hello","i"},{"^w\\w+","m"},
+                                        {"ERROR (\\d+)","S"},{"stra\xc3\x9f""e","iu"},{"",""},{"(a)|(b)","x"}};
+static const char* const subject="Hello world 2016-10 ERROR 42\nwhat STRASSE stra\xc3\x9f""e ab";
+
+///Saves the patterns, with one in the C locale so the file has two blocks
+static std::string saveAll(std::vector<std::unique_ptr<jpcre2::Regex> >& saved){
+    jpcre2::RegexArchive out;
+    for(auto& p : patterns){
+        saved.emplace_back(new jpcre2::Regex(p[0],p[1]));
+        saved.back()->execute();
+        out.add(*saved.back());
+    }
+    saved.emplace_back(new jpcre2::Regex);
+    saved.back()->compile("[a-z]+","i").locale("C").execute();
+    out.add(*saved.back());
+    std::string path=tempPath();
+    out.save(path);
+    return path;
+}
+
+TEST_CASE(archive_round_trip){
+    std::vector<std::unique_ptr<jpcre2::Regex> > saved,loaded;
+    std::string path=saveAll(saved);
+    jpcre2::RegexArchive in;
+    CHECK(in.load(path,loaded)==saved.size());
+    CHECK(loaded.size()==saved.size());
+
+    for(size_t i=0;i<loaded.size() && i<saved.size();i++){
+        jpcre2::Regex& a=*saved[i];
+        jpcre2::Regex& b=*loaded[i];
+        CHECK(a.getPattern()==b.getPattern());
+        CHECK(a.getModifier()==b.getModifier());
+        CHECK(a.getLocale()==b.getLocale());
+        CHECK(a.getCompileOpts()==b.getCompileOpts());
+        CHECK(a.getRequiredLiteral()==b.getRequiredLiteral());
+        CHECK(!b.isJitCompiled());
+
+        jpcre2::VecNum va,vb;
+        jpcre2::VecNas na,nb;
+        jpcre2::RegexMatch ma(a),mb(b);
+        size_t ca=ma.subject(subject).findAll().numberedSubstringVector(va).namedSubstringVector(na).execute();
+        size_t cb=mb.subject(subject).findAll().numberedSubstringVector(vb).namedSubstringVector(nb).execute();
+        CHECK(ca==cb);
+        CHECK(va==vb);
+        CHECK(na==nb);
+        ///JIT code isn't saved, the first match compiles it
+        CHECK(b.isJitCompiled()==a.isJitCompiled());
+        CHECK(a.replace(subject,"<$0>").modifiers("g").execute()==b.replace(subject,"<$0>").modifiers("g").execute());
+    }
+
+    ///Loading again appends
+    CHECK(in.load(path,loaded)==saved.size());
+    CHECK(loaded.size()==2*saved.size());
+    unlink(path.c_str());
+}
+
+///Loaded patterns carry the copy of the tables pcre2_serialize_decode() made,
+///they're saved again along with patterns compiled here in the same locale
+TEST_CASE(archive_resave_loaded){
+    std::vector<std::unique_ptr<jpcre2::Regex> > saved,loaded,again;
+    std::string path=saveAll(saved);
+    jpcre2::RegexArchive in;
+    in.load(path,loaded);
+    
+    jpcre2::RegexArchive out;
+    for(auto& re : loaded) out.add(*re);
+    jpcre2::Regex added("w(or)ld","i");
+    added.execute();
+    out.add(added);
+    jpcre2::Regex added_c;
+    added_c.compile("[A-Z]+").locale("C").execute();
+    out.add(added_c);
+    ///A copy of a loaded pattern shares its tables
+    jpcre2::Regex copy(*loaded[1]);
+    out.add(copy);
+    out.save(path);
+    
+    CHECK(in.load(path,again)==loaded.size()+3);
+    CHECK(again.size()==loaded.size()+3);
+    std::vector<jpcre2::Regex*> expected;
+    for(auto& re : loaded) expected.push_back(re.get());
+    expected.push_back(&added);
+    expected.push_back(&added_c);
+    expected.push_back(&copy);
+    for(size_t i=0;i<again.size() && i<expected.size();i++){
+        jpcre2::Regex& a=*expected[i];
+        jpcre2::Regex& b=*again[i];
+        CHECK(a.getPattern()==b.getPattern());
+        CHECK(a.getLocale()==b.getLocale());
+        jpcre2::VecNum va,vb;
+        jpcre2::RegexMatch ma(a),mb(b);
+        CHECK(ma.subject(subject).findAll().numberedSubstringVector(va).execute()==
+              mb.subject(subject).findAll().numberedSubstringVector(vb).execute());
+        CHECK(va==vb);
+    }
+    
+    ///A loaded pattern compiled again uses the tables of its locale
+    loaded[0]->compile("h(el)lo","i").execute();
+    jpcre2::RegexArchive mixed;
+    mixed.add(*loaded[0]).add(added).add(*loaded[2]);
+    mixed.save(path);
+    again.clear();
+    CHECK(in.load(path,again)==3);
+    unlink(path.c_str());
+}
+
+TEST_CASE(archive_damaged_file){
+    std::vector<std::unique_ptr<jpcre2::Regex> > saved,loaded;
+    std::string path=saveAll(saved);
+    const std::string good=readFile(path);
+    CHECK(good.size()>24);
+    jpcre2::RegexArchive in;
+    in.load(path,loaded);
+    const size_t before=loaded.size();
+    std::string bad;
+
+    bad=good;
+    bad[0]='X';
+    writeFile(path,bad);
+    CHECK_THROWS(in.load(path,loaded),PCRE2_ERROR_BADMAGIC);
+    CHECK(in.getErrorCode()==PCRE2_ERROR_BADMAGIC);
+
+    bad=good;
+    putU32(bad,8,99);
+    writeFile(path,bad);
+    CHECK_THROWS(in.load(path,loaded),PCRE2_ERROR_BADMAGIC);
+
+    ///As saved on a machine of the other byte order: every header number swapped
+    bad=good;
+    for(size_t at=8;at<24;at+=4) std::reverse(bad.begin()+at,bad.begin()+at+4);
+    writeFile(path,bad);
+    CHECK_THROWS(in.load(path,loaded),PCRE2_ERROR_BADMODE);
+
+    ///Fewer blocks than the patterns refer to
+    bad=good;
+    putU32(bad,20,1);
+    writeFile(path,bad);
+    CHECK_THROWS(in.load(path,loaded),PCRE2_ERROR_BADSERIALIZEDDATA);
+
+    ///A string length running past the end
+    bad=good;
+    putU32(bad,40,0xffffff);
+    writeFile(path,bad);
+    CHECK_THROWS(in.load(path,loaded),PCRE2_ERROR_BADSERIALIZEDDATA);
+
+    ///pcre2_serialize_decode() checks its own header
+    bad=good;
+    size_t block=lastBlock(bad);
+    CHECK(block>24);
+    bad[block]^=0x55;
+    writeFile(path,bad);
+    CHECK_THROWS(in.load(path,loaded),PCRE2_ERROR_BADMAGIC);
+
+    for(size_t cut : {size_t(0),size_t(4),size_t(10),size_t(30),good.size()/2,good.size()-1}){
+        writeFile(path,good.substr(0,cut));
+        int thrown=0;
+        try{in.load(path,loaded);}catch(int e){thrown=e;}
+        CHECK(thrown==PCRE2_ERROR_BADMAGIC || thrown==PCRE2_ERROR_BADSERIALIZEDDATA);
+    }
+
+    CHECK(loaded.size()==before);
+    unlink(path.c_str());
+
+    CHECK_THROWS(in.load(path,loaded),jpcre2::ERROR::FILE_ERROR);
+    CHECK(in.getErrorCode()==jpcre2::ERROR::FILE_ERROR);
+    CHECK(loaded.size()==before);
+}
@@ -0,0 +1,31 @@
+#include "test_check.h"
+
+///RegexMatch::executeBatch() gives the same matches as matching the subjects one by one.
+
+TEST_CASE(batch_matches_in_subject_order){
+    jpcre2::Regex re("(\\d+)","S");
+    re.execute();
+    std::vector<std::string> subjects={"1 2","none","33","", "4 5 6"};
+    std::vector<size_t> counts;
+    jpcre2::VecNum vec_num;
+    jpcre2::MatchSet set;
+    jpcre2::RegexMatch rm(re);
+    CHECK(rm.findAll().numberedSubstringVector(vec_num).matchSet(set).executeBatch(subjects,counts)==6);
+    CHECK(counts==std::vector<size_t>({2,0,1,0,3}));
+    CHECK(vec_num.size()==6 && set.size()==6);
+    CHECK(vec_num[2][1]=="33" && vec_num[5][1]=="6");
+    CHECK(set.str(subjects[4],5,1)=="6");
+    
+    ///each subject alone gives the same
+    size_t k=0;
+    for(size_t i=0;i<subjects.size();i++){
+        jpcre2::VecNum one;
+        CHECK(re.match(subjects[i]).modifiers("g").numberedSubstringVector(one).execute()==counts[i]);
+        for(size_t j=0;j<one.size();j++,k++) CHECK(one[j]==vec_num[k]);
+    }
+    
+    ///without findAll() at most one match a subject
+    jpcre2::RegexMatch first(re);
+    CHECK(first.executeBatch(subjects,counts)==3);
+    CHECK(counts==std::vector<size_t>({1,0,1,0,1}));
+}
@@ -0,0 +1,33 @@
+#include "test_check.h"
+
+///Patterns, subjects and replacements with embedded zeros are handled by length.
+
+TEST_CASE(binary_subject_and_pattern){
+    std::string pat("a\\x00b",6);
+    jpcre2::Regex re(pat,"");
+    re.execute();
+    std::string subject("xa\0b a\0b",8);
+    jpcre2::VecSpan vec_span;
+    CHECK(re.match(subject).modifiers("g").numberedSpanVector(vec_span).execute()==2);
+    CHECK(vec_span[1][0].start==5 && vec_span[1][0].length==3);
+    
+    ///a literal zero in the pattern itself
+    jpcre2::Regex lit(std::string("a\0b",3),"");
+    lit.execute();
+    CHECK(lit.match(subject).modifiers("g").count()==2);
+    
+    ///a subject by pointer and length
+    jpcre2::RegexMatch rm(lit);
+    CHECK(rm.subject(subject.data(),4).modifiers("g").count()==1);
+}
+
+TEST_CASE(binary_replace){
+    jpcre2::Regex re("\\d","");
+    re.execute();
+    std::string subject("1\0002",3);
+    std::string repl("<\0>",3);
+    std::string result=re.replace(subject,repl).modifiers("g").execute();
+    CHECK(result==std::string("<\0>\0<\0>",7));
+    jpcre2::RegexReplace rr(re);
+    CHECK(rr.subject(subject.data(),1).replaceWith("x",1).execute()=="x");
+}
@@ -0,0 +1,83 @@
+#include "test_check.h"
+
+///The process-wide RegexCache: off by default, LRU eviction, and what makes two compiles the same.
+
+///Regex objects are made before the cache is turned on, as constructing one compiles an empty pattern.
+
+namespace{
+    ///Turns the cache on for a case and back off after it
+    struct CacheOn{
+        explicit CacheOn(jpcre2::Uint n)    {jpcre2::RegexCache::clear();jpcre2::RegexCache::setCapacity(n);}
+        ~CacheOn()                          {jpcre2::RegexCache::setCapacity(JPCRE2_CACHE_CAPACITY);jpcre2::RegexCache::clear();}
+    };
+    
+    struct MallocAllocator: jpcre2::Allocator{
+        void* allocate(jpcre2::Uint size)   {return std::malloc(size);}
+        void deallocate(void* p)            {std::free(p);}
+    };
+}
+
+TEST_CASE(cache_is_off_by_default){
+    CHECK(jpcre2::RegexCache::getCapacity()==0);
+    jpcre2::RegexCache::clear();
+    jpcre2::Regex a("off+",""),b("off+","");
+    a.execute();
+    b.execute();
+    CHECK(jpcre2::RegexCache::size()==0);
+    CHECK(jpcre2::RegexCache::getHits()==0);
+}
+
+TEST_CASE(cache_hits_and_keys){
+    jpcre2::Regex a("(\\d+)x","S"),b("(\\d+)x","S"),c("(\\d+)x","i"),d("(\\d+)x","S"),e("(\\d+)x","S"),bad;
+    CacheOn on(16);
+    a.execute();
+    b.execute();
+    CHECK(jpcre2::RegexCache::getMisses()==1);
+    CHECK(jpcre2::RegexCache::getHits()==1);
+    CHECK(b.isJitCompiled()==a.isJitCompiled());
+    CHECK(b.match("12x").execute()==1);
+    
+    ///modifiers, locale and options are part of the key
+    c.execute();
+    d.locale("C").execute();
+    e.pcre2Options(PCRE2_ANCHORED).execute();
+    CHECK(jpcre2::RegexCache::size()==4);
+    CHECK(jpcre2::RegexCache::getHits()==1);
+    CHECK(e.match("a12x").execute()==0);
+    
+    ///errors aren't cached, they are thrown every time
+    CHECK_THROWS(bad.compile("(","").execute(),PCRE2_ERROR_MISSING_CLOSING_PARENTHESIS);
+    CHECK_THROWS(bad.compile("(","").execute(),PCRE2_ERROR_MISSING_CLOSING_PARENTHESIS);
+    CHECK(jpcre2::RegexCache::size()==4);
+}
+
+TEST_CASE(cache_evicts_least_recently_used){
+    jpcre2::Regex a("a",""),b("b",""),c("c","");
+    CacheOn on(2);
+    a.execute();
+    b.execute();
+    a.execute();        ///a is now more recent than b
+    c.execute();        ///evicts b
+    CHECK(jpcre2::RegexCache::size()==2);
+    CHECK(jpcre2::RegexCache::getEvictions()==1);
+    jpcre2::Uint hits=jpcre2::RegexCache::getHits();
+    a.execute();
+    CHECK(jpcre2::RegexCache::getHits()==hits+1);
+    b.execute();
+    CHECK(jpcre2::RegexCache::getHits()==hits+1);
+    
+    ///an evicted pattern stays usable by the Regex objects that have it
+    jpcre2::RegexCache::setCapacity(0);
+    CHECK(jpcre2::RegexCache::size()==0);
+    CHECK(a.match("xa").execute()==1);
+    CHECK(c.match("xc").execute()==1);
+}
+
+TEST_CASE(cache_skips_allocator_patterns){
+    MallocAllocator alloc;
+    jpcre2::Regex re("alloc+","");
+    CacheOn on(16);
+    re.allocator(&alloc).execute();
+    CHECK(jpcre2::RegexCache::size()==0);
+    CHECK(re.match("allocc").execute()==1);
+}
@@ -0,0 +1,44 @@
+#include <vector>
+#include "test_check.h"
+
+///Runs the cases registered by the test_*.cpp files, or those with filter in their name:
+///
+///   ./jpcre2test [filter]
+///
+///Exits with 1 if any check failed. Jpcre2 errors escaping a case (thrown as int) fail it.
+
+typedef std::vector<std::pair<const char*,void(*)()> > Cases;
+
+static Cases& cases(){
+    static Cases all;
+    return all;
+}
+
+static int failures=0;
+static const char* current="";
+
+TestCase::TestCase(const char* name,void (*fn)()){
+    cases().push_back(std::make_pair(name,fn));
+}
+
+void checkFailed(const char* what,const char* file,int line){
+    std::cout<<file<<":"<<line<<": "<<current<<": check failed: "<<what<<std::endl;
+    failures++;
+}
+
+int main(int argc,char** argv){
+    std::string filter=argc>1?argv[1]:"";
+    int run=0;
+    for(size_t i=0;i<cases().size();i++){
+        if(!filter.empty() && std::string(cases()[i].first).find(filter)==std::string::npos) continue;
+        run++;
+        current=cases()[i].first;
+        try{cases()[i].second();}
+        catch(int e){
+            std::cout<<cases()[i].first<<": uncaught error "<<e<<": "<<jpcre2::Regex().getErrorMessage(e)<<std::endl;
+            failures++;
+        }
+    }
+    std::cout<<"jpcre2test: "<<run<<" cases, "<<failures<<" failed checks"<<std::endl;
+    return failures?1:0;
+}
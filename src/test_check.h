@@ -0,0 +1,24 @@
+#ifndef JPCRE2_TEST_CHECK_H
+#define JPCRE2_TEST_CHECK_H
+
+#include <iostream>
+#include "jpcre2.h"
+
+///Behaviour checks run by make check (jpcre2test). Each test_*.cpp registers its cases with TEST_CASE,
+///a failed CHECK prints what failed and where, and the run goes on with the next check.
+
+struct TestCase{
+    TestCase(const char* name,void (*fn)());
+};
+
+void checkFailed(const char* what,const char* file,int line);
+
+#define CHECK(x) do{ if(!(x)) checkFailed(#x,__FILE__,__LINE__); }while(0)
+
+///Checks that x throws the int code
+#define CHECK_THROWS(x,code) do{ int thrown_=0; try{x;}catch(int e_){thrown_=e_;} \
+                                 if(thrown_!=(code)) checkFailed(#x " throws " #code,__FILE__,__LINE__); }while(0)
+
+#define TEST_CASE(name) static void name(); static TestCase name##_case(#name,name); static void name()
+
+#endif
@@ -0,0 +1,50 @@
+#include "test_check.h"
+#include <random>
+
+///RegexMatch::count() and test() agree with execute() and extract nothing
+
+TEST_CASE(count_and_test_same_as_execute){
+    const char* const patterns[][2]={{"\\d+",""},{"x*",""},{"^\\w+","m"},{"\xc3\xa9+","u"},{"(?<w>[a-z]+)=(\\d+)",""},
+                                     {"",""},{"\\R",""},{"\xc3\xa9|x*","u"},{"(?=b)",""},{"$","m"},{"foo=1",""},{"(\\d)+","S"}};
+    const char* const pieces[]={"a","b","foo"," ","1","23","x","=","\n","\r\n","\xc3\xa9","ab","z"};
+    std::mt19937 rng(13);
+    for(auto& p : patterns){
+        jpcre2::Regex re(p[0],p[1]);
+        re.execute();
+        for(int k=0;k<100;k++){
+            std::string s;
+            for(int i=rng()%40;i>0;i--) s+=pieces[rng()%13];
+            size_t all=re.match(s).findAll().execute();
+            size_t first=re.match(s).execute();
+            jpcre2::RegexMatch rm(re);
+            rm.subject(&s);
+            CHECK(rm.count()==all);
+            CHECK(rm.test()==(first>0));
+            ///count() counts all matches whether or not findAll() was given
+            CHECK(rm.findAll().count()==all);
+        }
+    }
+}
+
+TEST_CASE(count_and_test_extract_nothing){
+    jpcre2::Regex re("(\\w+)@(\\w+)\\.com","S");
+    re.execute();
+    jpcre2::VecNum num(1);
+    num[0][0]="kept";
+    jpcre2::RegexMatch rm(re);
+    rm.subject("mail a@b.com and c@d.com, e@f.com").numberedSubstringVector(num);
+    CHECK(rm.count()==3);
+    CHECK(rm.test());
+    CHECK(num.size()==1 && num[0][0]=="kept");
+    
+    ///A subject without a match, nor the required literal
+    CHECK(!rm.subject("nothing here").test());
+    CHECK(rm.count()==0);
+    
+    ///Match errors are thrown as execute() throws them
+    jpcre2::Regex u("a","u");
+    u.execute();
+    jpcre2::RegexMatch um(u);
+    CHECK_THROWS(um.subject("\xff a").test(),PCRE2_ERROR_UTF8_ERR21);
+    CHECK_THROWS(um.count(),PCRE2_ERROR_UTF8_ERR21);
+}
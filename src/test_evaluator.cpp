@@ -0,0 +1,54 @@
+#include "test_check.h"
+#include <random>
+
+///RegexReplace::evaluator(): the replacement of each match is what the callback returns
+
+TEST_CASE(evaluator_same_as_replacement){
+    const char* const patterns[][2]={{"\\d+",""},{"x*",""},{"^\\w+","m"},{"\xc3\xa9+","u"},{"(?<w>[a-z]+)=(\\d+)?",""},
+                                     {"",""},{"\\R",""},{"\xc3\xa9|x*","u"},{"(?=b)",""},{"$","m"}};
+    const char* const pieces[]={"a","b","foo"," ","1","23","x","=","\n","\r\n","\xc3\xa9","ab","z"};
+    std::mt19937 rng(9);
+    for(auto& p : patterns){
+        jpcre2::Regex re(p[0],p[1]);
+        re.execute();
+        bool named=std::string(p[0]).find("(?<w>")!=std::string::npos;
+        for(const char* mod : {"","g"}){
+            for(int k=0;k<50;k++){
+                std::string s;
+                for(int i=rng()%40;i>0;i--) s+=pieces[rng()%13];
+                ///E makes unset groups empty, as MatchView::str() does
+                std::string expected=re.replace(s,named?"<${w}:$2>":"<$0@>").modifiers(std::string(mod)+"E").execute();
+                std::string got=re.replace(s).modifiers(mod).evaluator([&](const jpcre2::MatchView& m){
+                    return named ? "<"+m.str("w")+":"+m.str(2)+">" : "<"+m.str()+"@>";
+                }).execute();
+                CHECK(got==expected);
+            }
+        }
+    }
+}
+
+TEST_CASE(evaluator_state_and_reset){
+    jpcre2::Regex re("\\b\\d{3}-\\d{4}\\b");
+    re.execute();
+    std::map<std::string,std::string> tokens;
+    jpcre2::RegexReplace rr(re);
+    std::string out;
+    rr.subject("call 555-1234 or 555-9999, again 555-1234").modifiers("g").evaluator([&](const jpcre2::MatchView& m){
+        auto it=tokens.find(m.str());
+        if(it==tokens.end()) it=tokens.insert(std::make_pair(m.str(),"TOK"+std::to_string(tokens.size()))).first;
+        return it->second;
+    }).execute(out);
+    CHECK(out=="call TOK0 or TOK1, again TOK0");
+    CHECK(rr.getErrorCode()==3);
+    
+    ///The evaluator can stream too
+    std::ostringstream os;
+    CHECK(rr.execute(os)==3);
+    CHECK(os.str()=="call TOK0 or TOK1, again TOK0");
+    
+    ///evaluator(nullptr) goes back to the replacement string
+    CHECK(rr.evaluator(nullptr).replaceWith("#").execute()=="call # or #, again #");
+    
+    ///An exception thrown by the evaluator goes through
+    CHECK_THROWS(rr.evaluator([](const jpcre2::MatchView&)->std::string{throw 42;}).execute(),42);
+}
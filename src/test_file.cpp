@@ -0,0 +1,83 @@
+#include "test_check.h"
+#include <fstream>
+#include <random>
+#include <cstdlib>
+#include <unistd.h>
+
+///RegexMatch::executeFile() and RegexReplace::executeFile() give what execute() gives on the file's content.
+
+static std::string writeTemp(const std::string& content){
+    char path[]="/tmp/jpcre2testXXXXXX";
+    int fd=mkstemp(path);
+    if(fd<0) return "";
+    (void)!write(fd,content.data(),content.size());
+    close(fd);
+    return path;
+}
+
+static std::string readBack(int fd){
+    std::string s;
+    char buf[4096];
+    lseek(fd,0,SEEK_SET);
+    for(ssize_t n;(n=read(fd,buf,sizeof(buf)))>0;) s.append(buf,n);
+    return s;
+}
+
+TEST_CASE(file_same_as_execute){
+    const char* const patterns[][2]={{"\\d+",""},{"x*",""},{"^\\w+","m"},{"\xc3\xa9+","u"},{"(?<w>[a-z]+)=(\\d+)",""},
+                                     {"",""},{"\\R",""},{"(?=b)",""},{"$","m"}};
+    const char* const pieces[]={"a","b","foo"," ","1","23","x","=","\n","\r\n","\xc3\xa9","ab","z"};
+    std::mt19937 rng(5);
+    char out_path[]="/tmp/jpcre2testXXXXXX";
+    int out=mkstemp(out_path);
+    CHECK(out>=0);
+    for(auto& p : patterns){
+        jpcre2::Regex re(p[0],p[1]);
+        re.execute();
+        for(const char* mod : {"","g"}){
+            for(int k=0;k<20;k++){
+                std::string s;
+                for(int i=rng()%40;i>0;i--) s+=pieces[rng()%13];
+                std::string path=writeTemp(s);
+                jpcre2::VecNum a,b;
+                jpcre2::VecSpan sa,sb;
+                CHECK(re.match(s).modifiers(mod).numberedSubstringVector(a).numberedSpanVector(sa).execute()
+                      ==jpcre2::RegexMatch(re).modifiers(mod).numberedSubstringVector(b).numberedSpanVector(sb).executeFile(path));
+                CHECK(a==b);
+                bool same=sa.size()==sb.size();
+                for(size_t i=0;same && i<sa.size();i++) same=sa[i][0].start==sb[i][0].start && sa[i][0].length==sb[i][0].length;
+                CHECK(same);
+                
+                CHECK(ftruncate(out,0)==0 && lseek(out,0,SEEK_SET)==0);
+                jpcre2::RegexReplace rr(re);
+                rr.replaceWith("[$0]").modifiers(mod).executeFile(path,out);
+                CHECK(readBack(out)==re.replace(s,"[$0]").modifiers(mod).execute());
+                unlink(path.c_str());
+            }
+        }
+    }
+    close(out);
+    unlink(out_path);
+}
+
+TEST_CASE(file_errors){
+    jpcre2::Regex re("a");
+    re.execute();
+    jpcre2::RegexMatch rm(re);
+    CHECK_THROWS(rm.executeFile("/nonexistent/jpcre2test"),jpcre2::ERROR::FILE_ERROR);
+    CHECK(!rm.getErrorMessage().empty());
+    
+    std::string path=writeTemp("banana");
+    jpcre2::RegexReplace rr(re);
+    CHECK_THROWS(rr.replaceWith("o").executeFile("/nonexistent/jpcre2test",1),jpcre2::ERROR::FILE_ERROR);
+    CHECK_THROWS(rr.executeFile(path,-1),jpcre2::ERROR::FILE_ERROR);
+    unlink(path.c_str());
+    
+    ///an empty file is an empty subject
+    path=writeTemp("");
+    jpcre2::Regex star("a*");
+    star.execute();
+    CHECK(jpcre2::RegexMatch(star).executeFile(path)==1);
+    CHECK(jpcre2::RegexMatch(re).executeFile(path)==0);
+    unlink(path.c_str());
+}
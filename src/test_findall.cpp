@@ -0,0 +1,63 @@
+#include "test_check.h"
+
+///Global matching (the g modifier) through execute(), count() and iterate() must find the same matches,
+///with the interpreter and with JIT (pcre2_jit_match()).
+
+static size_t iterated(jpcre2::Regex& re,const std::string& subject,const std::string& mod,uint32_t opts=0){
+    jpcre2::RegexMatch rm(re,subject);
+    size_t n=0;
+    for(const jpcre2::MatchView& m : rm.modifiers(mod).pcre2Options(opts).iterate()){(void)m; n++;}
+    return n;
+}
+
+///Checks all three ways of matching against an expected number of matches
+static void checkCount(const std::string& pat,const std::string& subject,const std::string& mod,
+                       uint32_t opts,size_t expected){
+    for(int jit=0;jit<2;jit++){
+        jpcre2::Regex re(pat,jit?"S":"");
+        re.execute();
+        jpcre2::VecNum vec_num;
+        size_t found=re.match(subject).modifiers(mod).pcre2Options(opts).numberedSubstringVector(vec_num).execute();
+        CHECK(found==expected);
+        CHECK(vec_num.size()==expected);
+        CHECK(re.match(subject).modifiers(mod).pcre2Options(opts).count()==expected);
+        CHECK(iterated(re,subject,mod,opts)==expected);
+    }
+}
+
+TEST_CASE(anchored_global_stops_at_first_miss){
+    ///A anchors every match at the end of the previous one: 1 and 2, not 3 and 4
+    checkCount("\\d","12a34","Ag",0,2);
+    checkCount("\\d","12a34","g",PCRE2_ANCHORED,2);
+    checkCount("\\d","a1234","Ag",0,0);
+}
+
+TEST_CASE(notbol_global){
+    checkCount("^a","aaa","g",PCRE2_NOTBOL,0);
+    checkCount("^a","aaa","g",0,1);
+    checkCount("(?m)^a","a\na","g",PCRE2_NOTBOL,1);
+}
+
+TEST_CASE(empty_matches){
+    ///empty at 0, xx at 1, empty at 3 and at the end
+    checkCount("x*","axxb","g",0,4);
+    checkCount("","abc","g",0,4);
+    checkCount("(?=b)|b","abab","g",0,4);
+}
+
+TEST_CASE(crlf_and_utf_advance){
+    checkCount("(*CRLF)(?m)$","a\r\nb\r\n","g",0,3);
+    checkCount("(*UTF)x*","\xc3\xa9\xc3\xa9","g",0,3);
+}
+
+TEST_CASE(jit_and_interpreter_agree){
+    jpcre2::Regex plain("(?<k>\\w+)=(?<v>\\d+)",""),jit("(?<k>\\w+)=(?<v>\\d+)","S");
+    plain.execute();
+    jit.execute();
+    std::string subject="a=1, bb=22, ccc=x, d=4444";
+    jpcre2::VecNas a,b;
+    CHECK(plain.match(subject).modifiers("g").namedSubstringVector(a).execute()==3);
+    CHECK(jit.match(subject).modifiers("g").namedSubstringVector(b).execute()==3);
+    CHECK(a==b);
+    CHECK(a[2]["k"]=="d" && a[2]["v"]=="4444");
+}
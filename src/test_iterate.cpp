@@ -0,0 +1,69 @@
+#include "test_check.h"
+#include <random>
+
+///RegexMatch::iterate() gives the matches execute() finds, each only when the iteration gets to it
+
+TEST_CASE(iterate_same_as_execute){
+    const char* const patterns[][2]={{"\\d+",""},{"x*",""},{"^\\w+","m"},{"\xc3\xa9+","u"},{"(?<w>[a-z]+)=(\\d+)",""},
+                                     {"",""},{"\\R",""},{"\xc3\xa9|x*","u"},{"(?=b)",""},{"$","m"},{"foo=1",""},{"\\d+","S"}};
+    const char* const pieces[]={"a","b","foo"," ","1","23","x","=","\n","\r\n","\xc3\xa9","ab","z"};
+    std::mt19937 rng(11);
+    for(auto& p : patterns){
+        jpcre2::Regex re(p[0],p[1]);
+        re.execute();
+        for(const char* mod : {"","g"}){
+            for(int k=0;k<50;k++){
+                std::string s;
+                for(int i=rng()%40;i>0;i--) s+=pieces[rng()%13];
+                jpcre2::VecSpan spans;
+                jpcre2::VecNum num;
+                size_t count=re.match(s).modifiers(mod).numberedSpanVector(spans).numberedSubstringVector(num).execute();
+                jpcre2::RegexMatch rm(re);
+                size_t i=0;
+                bool same=true;
+                for(const jpcre2::MatchView& m : rm.subject(&s).modifiers(mod).iterate()){
+                    same=same && i<count && m.start()==spans[i][0].start && m.length()==spans[i][0].length &&
+                         m.groups()==num[i].size();
+                    for(jpcre2::Uint g=0;same && g<m.groups();g++) same=m.str(g)==num[i][g];
+                    i++;
+                }
+                CHECK(same && i==count);
+            }
+        }
+    }
+}
+
+TEST_CASE(iterate_lazily){
+    jpcre2::Regex re("\\d+");
+    re.execute();
+    re.collectStats();
+    std::string big(1000000,'a');
+    for(size_t i=0;i<big.size();i+=100) big[i]='7';
+    std::vector<size_t> starts;
+    for(const jpcre2::MatchView& m : re.match(big).findAll().iterate()){
+        starts.push_back(m.start());
+        if(starts.size()==5) break;
+    }
+    CHECK(starts==std::vector<size_t>({0,100,200,300,400}));
+    ///Only the matches that were looked at were searched for
+    CHECK(re.getStats().calls==5);
+    re.collectStats(false);
+    
+    jpcre2::RegexMatch rm(re);
+    rm.subject("a1b22c333").findAll();
+    jpcre2::MatchRange range=rm.iterate();
+    jpcre2::MatchRange::iterator it=range.begin();
+    CHECK(it->str()=="1");
+    ++it;
+    CHECK((*it).str()=="22" && it->start()==3);
+    ++it;
+    CHECK(it!=range.end());
+    ++it;
+    CHECK(it==range.end());
+    
+    ///An invalid subject is an error thrown by the first step
+    jpcre2::Regex u("a","u");
+    u.execute();
+    jpcre2::RegexMatch um(u);
+    CHECK_THROWS(for(const jpcre2::MatchView& m : um.subject("\xff a").findAll().iterate()) (void)m,PCRE2_ERROR_UTF8_ERR21);
+}
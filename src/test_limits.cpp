@@ -0,0 +1,89 @@
+#include "test_check.h"
+
+///Match, depth, heap and time limits: once one is set, hitting it stops the match without throwing,
+///with what was found before it kept.
+
+TEST_CASE(limits_stop_runaway_match){
+    jpcre2::Regex re("(a+)+$");
+    re.execute();
+    std::string evil=std::string(24,'a')+"b";
+    jpcre2::RegexMatch m(re);
+    m.subject(&evil);
+    
+    ///Without a limit set, PCRE2's own limit is an error
+    CHECK_THROWS(m.execute(),PCRE2_ERROR_MATCHLIMIT);
+    CHECK(!m.limitReached());
+    
+    CHECK(m.matchLimit(10000).execute()==0);
+    CHECK(m.limitReached());
+    CHECK(m.getErrorCode()==PCRE2_ERROR_MATCHLIMIT);
+    CHECK(m.count()==0 && m.limitReached());
+    CHECK(!m.test() && m.limitReached());
+    
+    CHECK(m.matchLimit(0).depthLimit(5).execute()==0);
+    CHECK(m.limitReached() && m.getErrorCode()==PCRE2_ERROR_DEPTHLIMIT);
+    
+    std::string deep=std::string(5000,'a')+"z";
+    jpcre2::Regex frames("((a)|b)*z");
+    frames.execute();
+    jpcre2::RegexMatch fm(frames);
+    CHECK(fm.subject(&deep).heapLimit(1).execute()==0);
+    CHECK(fm.limitReached() && fm.getErrorCode()==PCRE2_ERROR_HEAPLIMIT);
+    CHECK(fm.heapLimit(0).execute()==1 && !fm.limitReached());
+    
+    ///JIT code honours the match limit
+    jpcre2::Regex jit("(a+)+$","S");
+    jit.execute();
+    jpcre2::RegexMatch jm(jit);
+    CHECK(jm.subject(&evil).matchLimit(10000).execute()==0);
+    CHECK(jm.limitReached() && jm.getErrorCode()==PCRE2_ERROR_MATCHLIMIT);
+    
+    ///A subject that matches is not affected
+    CHECK(m.depthLimit(0).matchLimit(100000).subject("xx aaa").execute()==1 && !m.limitReached());
+}
+
+TEST_CASE(limits_keep_what_was_found){
+    jpcre2::Regex re("\\d+");
+    re.execute();
+    std::string big;
+    for(int i=0;i<200000;i++) big+="x"+std::to_string(i);
+    
+    jpcre2::VecNum all;
+    jpcre2::RegexMatch m(re);
+    size_t total=m.subject(&big).findAll().numberedSubstringVector(all).execute();
+    CHECK(total==200000);
+    
+    ///The time limit runs out among the matches of a findAll()
+    jpcre2::VecNum found;
+    m.numberedSubstringVector(found).timeLimit(1);
+    size_t n=m.execute();
+    CHECK(m.limitReached() && m.getErrorCode()==jpcre2::ERROR::TIME_LIMIT);
+    CHECK(n<total && found.size()==n);
+    CHECK(std::equal(found.begin(),found.end(),all.begin()));
+    CHECK(m.timeLimit(0).execute()==total && !m.limitReached());
+    
+    size_t iterated=0;
+    m.timeLimit(1);
+    for(const jpcre2::MatchView& v : m.iterate()){(void)v; iterated++;}
+    CHECK(iterated<total && m.limitReached());
+    
+    ///A replace leaves the rest of the subject as it is
+    std::string full=re.replace(big,"N").modifiers("g").execute();
+    jpcre2::RegexReplace rr(re);
+    std::string out;
+    rr.subject(&big).replaceWith("N").modifiers("g").timeLimit(1).execute(out);
+    CHECK(rr.limitReached() && rr.getErrorCode()==jpcre2::ERROR::TIME_LIMIT);
+    CHECK(out!=full);
+    ///out is a prefix of the full result followed by the untouched rest of the subject
+    size_t common=0;
+    while(common<out.size() && common<full.size() && out[common]==full[common]) common++;
+    CHECK(common>0 || out==big);
+    CHECK(big.compare(big.size()-(out.size()-common),std::string::npos,out,common,std::string::npos)==0);
+    rr.timeLimit(0).execute(out);
+    CHECK(out==full && !rr.limitReached());
+    
+    ///Regex::match() starts without limits
+    jpcre2::Regex evil("(a+)+$");
+    evil.execute();
+    CHECK_THROWS(evil.match(std::string(24,'a')+"b").execute(),PCRE2_ERROR_MATCHLIMIT);
+}
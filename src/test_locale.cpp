@@ -0,0 +1,41 @@
+#include "test_check.h"
+#include <clocale>
+#include <cctype>
+
+///Patterns compiled in a locale use its character tables, made once per locale,
+///and compiling leaves the LC_CTYPE of the process as it was.
+
+static bool isWord(int c){return std::isalnum(c) || c=='_';}
+
+TEST_CASE(locale_tables){
+    std::vector<std::string> locales={"none","C","C.UTF-8","de_DE.ISO-8859-1","fr_FR.ISO-8859-1","tr_TR.ISO-8859-9"};
+    if(const char* extra=std::getenv("JPCRE2_TEST_LOCALE")) locales.push_back(extra);
+    std::string before=std::setlocale(LC_CTYPE,NULL);
+    
+    ///Twice over, the second time with the tables made the first time
+    for(int round=0;round<2;round++){
+        for(const std::string& loc : locales){
+            if(loc!="none" && !std::setlocale(LC_CTYPE,loc.c_str())) continue;
+            std::string expected;
+            for(int c=1;c<256;c++) if(loc=="none" ? c<128 && isWord(c) : isWord(c)) expected+=(char)c;
+            std::setlocale(LC_CTYPE,before.c_str());
+            
+            jpcre2::Regex re;
+            re.locale(loc).compile("\\w").execute();
+            CHECK(std::setlocale(LC_CTYPE,NULL)==before);
+            std::string got;
+            for(int c=1;c<256;c++) if(re.match(std::string(1,(char)c)).test()) got+=(char)c;
+            CHECK(got==expected);
+        }
+    }
+}
+
+TEST_CASE(locale_recompiles){
+    ///Recompiling one Regex in locale after locale
+    jpcre2::Regex re;
+    const char* const locales[]={"none","C","C.UTF-8"};
+    for(int i=0;i<3000;i++){
+        re.locale(locales[i%3]).compile("\\w+(\\d)").execute();
+        CHECK(re.match("ab1").execute()==1);
+    }
+}
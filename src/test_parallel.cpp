@@ -0,0 +1,90 @@
+#include "test_check.h"
+
+///Regex::matchParallel() and replaceParallel() give what execute() does, however many threads
+///cut the subject into pieces, for patterns that look around or match across the cuts.
+
+static std::string bigSubject(){
+    std::string s;
+    for(int i=0;s.size()<1500000;i++){
+        if(i%7==0) s+="    ";
+        s+="foo"+std::to_string(i)+" xy"+std::to_string(i%10)+" bar_foo foo\n";
+        if(i%11==0) s+="\n  a long\nrun z\n";
+    }
+    return s;
+}
+
+static const char* const patterns[]={
+    "(?m)^\\w+",            ///line starts, after a cut too
+    "\\bfoo\\b",            ///word boundaries look back over a cut
+    "(?<=xy)\\d",           ///lookbehind
+    "\\d(?=\\s+\\S)",       ///lookahead past the end of a piece
+    "\\s+",                 ///runs over the cuts
+    "(?s)a long.*?z",       ///across lines
+    "^foo\\d",              ///start of the subject only
+    "(?m)$",                ///empty matches
+    "(?s)foo1.*",           ///one match over all the pieces
+};
+
+TEST_CASE(parallel_match_same_as_execute){
+    std::string s=bigSubject();
+    for(const char* p : patterns){
+        jpcre2::Regex re(p,"S");
+        re.execute();
+        jpcre2::VecNum num;
+        jpcre2::VecSpan span;
+        size_t count=re.match(s).modifiers("g").numberedSubstringVector(num).numberedSpanVector(span).execute();
+        for(size_t threads : {1,2,3,8}){
+            jpcre2::VecNum pnum;
+            jpcre2::VecSpan pspan;
+            CHECK(re.matchParallel(s,"g",&pnum,&pspan,threads)==count);
+            CHECK(pnum==num);
+            CHECK(pspan.size()==span.size());
+            for(size_t i=0;i<span.size() && i<pspan.size();i++)
+                CHECK(pspan[i][0].start==span[i][0].start && pspan[i][0].length==span[i][0].length);
+        }
+    }
+}
+
+TEST_CASE(parallel_replace_same_as_execute){
+    std::string s=bigSubject();
+    for(const char* p : patterns){
+        jpcre2::Regex re(p,"S");
+        re.execute();
+        std::string expected=re.replace(s,"<$0>").modifiers("g").execute();
+        for(size_t threads : {1,2,3,8}) CHECK(re.replaceParallel(s,"<$0>","g",threads)==expected);
+    }
+}
+
+TEST_CASE(parallel_batch_same_as_each){
+    jpcre2::Regex re("\\b(\\w)\\w*","S");
+    re.execute();
+    ///small batches stay on the calling thread, big ones don't
+    for(size_t n : {3,5000}){
+        std::vector<std::string> subjects;
+        for(size_t i=0;i<n;i++) subjects.push_back("word "+std::to_string(i)+std::string(i%5*8,'x')+" end");
+        std::vector<size_t> counts;
+        jpcre2::VecNum num;
+        size_t total=re.matchParallel(subjects,counts,"g",&num,nullptr,4);
+        std::vector<std::string> results;
+        re.replaceParallel(subjects,results,"[$1]","g",4);
+        size_t k=0;
+        for(size_t i=0;i<n;i++){
+            jpcre2::VecNum one;
+            CHECK(re.match(subjects[i]).modifiers("g").numberedSubstringVector(one).execute()==counts[i]);
+            for(size_t j=0;j<one.size() && k<num.size();j++,k++) CHECK(one[j]==num[k]);
+            CHECK(results[i]==re.replace(subjects[i],"[$1]").modifiers("g").execute());
+        }
+        CHECK(k==total);
+    }
+}
+
+TEST_CASE(parallel_invalid_utf_throws){
+    std::string s=bigSubject();
+    s[s.size()/2]='\xff';
+    jpcre2::Regex re("foo","u");
+    re.execute();
+    int serial=0,parallel=0;
+    try{re.match(s).modifiers("g").execute();}catch(int e){serial=e;}
+    try{re.matchParallel(s,"g",nullptr,nullptr,4);}catch(int e){parallel=e;}
+    CHECK(serial<0 && parallel==serial);
+}
@@ -0,0 +1,63 @@
+#include "test_check.h"
+
+///The literal prefilter rejects subjects without the required literal of a pattern,
+///and matching and replacing give what they would without it.
+
+TEST_CASE(prefilter_literal_of_pattern){
+    CHECK(jpcre2::Regex("user_id=\\d+").getRequiredLiteral()=="");      ///not compiled yet
+    jpcre2::Regex re("user_id=\\d+");
+    re.execute();
+    CHECK(re.getRequiredLiteral()=="user_id=");
+    
+    jpcre2::Regex escaped("x\\.y\\d");
+    escaped.execute();
+    CHECK(escaped.getRequiredLiteral()=="x.y");
+    
+    ///no literal where it may not be all there
+    for(const char* p : {"a|bc","(?i)abc","[abc]+","(*ACCEPT)abc"}){
+        jpcre2::Regex none(p);
+        none.execute();
+        CHECK(none.getRequiredLiteral()=="");
+    }
+    jpcre2::Regex caseless("abc","i");
+    caseless.execute();
+    CHECK(caseless.getRequiredLiteral()=="");
+}
+
+TEST_CASE(prefilter_same_results){
+    jpcre2::Regex re("user_id=(\\d+)","S");
+    jpcre2::Regex plain("(?:user_id=)(\\d+)","S");      ///the same without a literal
+    re.execute();
+    plain.execute();
+    CHECK(plain.getRequiredLiteral()=="");
+    
+    std::string subjects[]={"user_id=42","none here","user_id= x user_id=7 user_id=8","user_i","",
+                            std::string(1000,'u')};
+    for(const std::string& s : subjects){
+        jpcre2::VecNum a,b;
+        CHECK(re.match(s).modifiers("g").numberedSubstringVector(a).execute()==
+              plain.match(s).modifiers("g").numberedSubstringVector(b).execute());
+        CHECK(a==b);
+        CHECK(jpcre2::RegexMatch(re,s).count()==jpcre2::RegexMatch(plain,s).count());
+        CHECK(jpcre2::RegexMatch(re,s).test()==jpcre2::RegexMatch(plain,s).test());
+        CHECK(re.replace(s,"[$1]").modifiers("g").execute()==plain.replace(s,"[$1]").modifiers("g").execute());
+    }
+    
+    ///four calls a subject, "none here", "user_i", "" and the u's can't match
+    CHECK(re.getPrefilterChecks()==6*4);
+    CHECK(re.getPrefilterRejects()==4*4);
+    CHECK(plain.getPrefilterChecks()==0);
+}
+
+TEST_CASE(prefilter_invalid_utf_still_reported){
+    jpcre2::Regex re("abc","u");
+    re.execute();
+    CHECK(re.getRequiredLiteral()=="abc");
+    int err=0;
+    try{re.match("x\xff").execute();}catch(int e){err=e;}
+    CHECK(err<0 && err!=PCRE2_ERROR_NOMATCH);
+    
+    ///unless the check is turned off
+    CHECK(jpcre2::RegexMatch(re,"x\xff").pcre2Options(PCRE2_NO_UTF_CHECK).execute()==0);
+    CHECK(re.getPrefilterRejects()==1);
+}
@@ -0,0 +1,97 @@
+#include <thread>
+#include "test_check.h"
+
+///Copying and moving Regex objects, the per call settings of Regex::match()
+///and matching one Regex from several threads.
+
+TEST_CASE(copy_shares_compiled_pattern){
+    jpcre2::Regex a("(\\d+)-(?<name>\\w+)","S");
+    a.execute();
+    jpcre2::Regex b(a);
+    CHECK(b.getPattern()=="(\\d+)-(?<name>\\w+)");
+    CHECK(b.getModifier()=="S");
+    CHECK(b.isJitCompiled()==a.isJitCompiled());
+    CHECK(b.getNameTable().size()==1);
+    CHECK(b.match("x 12-ab 34-cd").modifiers("g").execute()==2);
+    
+    jpcre2::Regex c;
+    c=a;
+    {
+        jpcre2::Regex gone("[a-z]+","");
+        gone.execute();
+        c=gone;
+    }
+    ///gone is destroyed, c still has its code
+    CHECK(c.getPattern()=="[a-z]+");
+    CHECK(c.match("12 ab").modifiers("g").execute()==1);
+    c=c;
+    CHECK(c.match("ab cd").modifiers("g").execute()==2);
+    
+    ///compiling the copy leaves the original alone
+    b.compile("x","").execute();
+    CHECK(a.match("12-ab").execute()==1);
+    CHECK(b.match("12-ab").execute()==0);
+}
+
+TEST_CASE(move_takes_compiled_pattern){
+    jpcre2::Regex a("b+","");
+    a.execute();
+    a.collectStats();
+    jpcre2::Regex b(std::move(a));
+    CHECK(b.match("abbc").execute()==1);
+    CHECK(b.isCollectingStats());
+    CHECK(!a.isCollectingStats());
+    
+    jpcre2::Regex c;
+    c=std::move(b);
+    CHECK(c.match("abbc bb").modifiers("g").execute()==2);
+    CHECK(c.getStats().calls>=3);
+    
+    ///the registry lists the new owner once
+    std::vector<jpcre2::MatchStats> all=jpcre2::RegexStats::snapshot();
+    int listed=0;
+    for(size_t i=0;i<all.size();i++) if(all[i].pattern=="b+") listed++;
+    CHECK(listed==1);
+    
+    ///a moved from Regex can be compiled again
+    a.compile("a","").execute();
+    CHECK(a.match("cab").execute()==1);
+}
+
+TEST_CASE(match_resets_jit_stack){
+    uint32_t jit=0;
+    pcre2_config(PCRE2_CONFIG_JIT,&jit);
+    if(!jit) return;
+    ///deep enough to run out of the default 32K JIT stack
+    jpcre2::Regex re("(a|b)*c","S");
+    re.execute();
+    std::string subject;
+    for(int i=0;i<50000;i++) subject+="ab";
+    subject+="c";
+    
+    jpcre2::RegexMatch& big=re.match(subject).jitStack(32*1024,16*1024*1024);
+    CHECK(big.execute()==1);
+    CHECK(big.getWarningMessage().empty());
+    
+    ///a new match() is back to the default stack, which falls back to the interpreter
+    jpcre2::RegexMatch& plain=re.match(subject);
+    CHECK(plain.execute()==1);
+    CHECK(plain.getWarningMessage().find("JIT stack limit")!=std::string::npos);
+}
+
+TEST_CASE(shared_regex_from_threads){
+    jpcre2::Regex re("(\\w+)@(\\w+)\\.com","S");
+    re.execute();
+    std::string subject;
+    for(int i=0;i<1000;i++) subject+="user"+jpcre2_utils::toString(i)+"@example.com, ";
+    
+    std::vector<size_t> counts(4,0);
+    std::vector<std::thread> threads;
+    for(int t=0;t<4;t++) threads.push_back(std::thread([&re,&subject,&counts,t]{
+        jpcre2::RegexMatch rm(re);
+        jpcre2::VecNum vec_num;
+        for(int i=0;i<20;i++) counts[t]+=rm.subject(&subject).numberedSubstringVector(vec_num).findAll().execute();
+    }));
+    for(size_t t=0;t<threads.size();t++) threads[t].join();
+    for(int t=0;t<4;t++) CHECK(counts[t]==20000);
+}
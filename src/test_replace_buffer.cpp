@@ -0,0 +1,54 @@
+#include "test_check.h"
+
+///The output buffer of RegexReplace::execute(String&): guessed, grown when the guess is short,
+///reused across calls, and the subject being the result string itself.
+
+TEST_CASE(replace_output_longer_than_guess){
+    jpcre2::Regex re("a","");
+    re.execute();
+    std::string subject(1000,'a');
+    std::string repl(10,'b');
+    std::string result=re.replace(subject,repl).modifiers("g").execute();
+    CHECK(result==std::string(10000,'b'));
+    ///a hint too small or too big gives the same result
+    CHECK(re.replace(subject,repl).modifiers("g").bufferSize(1).execute()==result);
+    CHECK(re.replace(subject,repl).modifiers("g").bufferSize(1<<20).execute()==result);
+    CHECK(re.replace(subject,"").modifiers("g").execute().empty());
+}
+
+TEST_CASE(replace_reuses_result){
+    jpcre2::Regex re("(\\w+)@(\\w+)","");
+    re.execute();
+    jpcre2::RegexReplace rr(re);
+    std::string result="left over from before, longer than any of the results below";
+    rr.subject("to x@y and z@w").replaceWith("$2 at $1").modifiers("g").execute(result);
+    CHECK(result=="to y at x and w at z");
+    rr.subject("x@y").execute(result);
+    CHECK(result=="y at x");
+    rr.subject("nothing to replace").execute(result);
+    CHECK(result=="nothing to replace");
+    rr.subject(std::string(5000,'q')+" a@b").execute(result);
+    CHECK(result==std::string(5000,'q')+" b at a");
+}
+
+TEST_CASE(replace_subject_into_itself){
+    jpcre2::Regex re("(\\d+)","");
+    re.execute();
+    std::string s="1 22 333";
+    jpcre2::RegexReplace rr(re);
+    rr.subject(&s).replaceWith("<$1$1$1>").modifiers("g").execute(s);
+    CHECK(s=="<111> <222222> <333333333>");
+    
+    ///the one pass paths (evaluator and limits) too
+    s="1 22 333";
+    rr.subject(&s).evaluator([](const jpcre2::MatchView& m){return "["+m.str(1)+"]";}).execute(s);
+    CHECK(s=="[1] [22] [333]");
+    s="1 22 333";
+    rr.evaluator(nullptr).matchLimit(100000).subject(&s).replaceWith("$1$1").execute(s);
+    CHECK(s=="11 2222 333333");
+    
+    ///a subject inside the result string
+    s="head 4 5 tail";
+    rr.subject(s.data()+5,3).execute(s);
+    CHECK(s=="44 55");
+}
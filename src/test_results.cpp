@@ -0,0 +1,80 @@
+#include "test_check.h"
+
+///The results of RegexMatch::execute(): substring maps, spans and MatchSet,
+///and the pooled match data blocks they are read from.
+
+TEST_CASE(results_after_recompile){
+    ///Pooled blocks are sized for the pattern, a pattern with more groups must not reuse them
+    jpcre2::Regex re("(a)","");
+    re.execute();
+    jpcre2::VecNum vec_num;
+    for(int i=0;i<3;i++) CHECK(re.match("xa").numberedSubstringVector(vec_num).execute()==1);
+    re.compile("(a)(b)(c)(d)(e)(f)(g)(h)(i)(j)(k)","").execute();
+    CHECK(re.match("abcdefghijk").numberedSubstringVector(vec_num).execute()==1);
+    CHECK(vec_num.size()==1 && vec_num[0].size()==12);
+    CHECK(vec_num[0][11]=="k");
+    re.compile("x","").execute();
+    CHECK(re.match("axb").numberedSubstringVector(vec_num).execute()==1);
+    CHECK(vec_num[0].size()==1 && vec_num[0][0]=="x");
+}
+
+TEST_CASE(results_without_vectors){
+    jpcre2::Regex re("(\\d)","");
+    re.execute();
+    CHECK(re.match("1 2 3").modifiers("g").execute()==3);
+    CHECK(re.match("none").modifiers("g").execute()==0);
+}
+
+TEST_CASE(results_maps_and_spans){
+    jpcre2::Regex re("(?<key>\\w+)=(?<value>\\d+)?(x)?","");
+    re.execute();
+    std::string subject="a=1 b= c=33x";
+    jpcre2::VecNum vec_num;
+    jpcre2::VecNas vec_nas;
+    jpcre2::VecNtN vec_ntn;
+    jpcre2::VecSpan vec_span;
+    CHECK(re.match(subject).modifiers("g").numberedSubstringVector(vec_num).namedSubstringVector(vec_nas)
+            .nameToNumberMapVector(vec_ntn).numberedSpanVector(vec_span).execute()==3);
+    CHECK(vec_num.size()==3 && vec_nas.size()==3 && vec_ntn.size()==3 && vec_span.size()==3);
+    CHECK(vec_num[2][0]=="c=33x" && vec_num[2][3]=="x");
+    CHECK(vec_nas[0]["key"]=="a" && vec_nas[0]["value"]=="1");
+    CHECK(vec_ntn[2]["value"]==2);
+    
+    ///spans are offsets into the subject, unset groups have start PCRE2_UNSET
+    CHECK(vec_span[0].size()==4);
+    CHECK(vec_span[2][0].start==7 && vec_span[2][0].length==5);
+    CHECK(vec_span[2][2].str(subject)=="33");
+    CHECK(!vec_span[1][2].isSet() && vec_span[1][2].str(subject).empty());
+    CHECK(vec_span[1][1].str(subject)=="b");
+}
+
+TEST_CASE(results_duplicate_names){
+    jpcre2::Regex re("(?:(?<n>\\d+)|(?<n>[a-z]+))!","J");
+    re.execute();
+    jpcre2::VecNas vec_nas;
+    jpcre2::VecNtN vec_ntn;
+    CHECK(re.match("12! ab!").modifiers("g").namedSubstringVector(vec_nas).nameToNumberMapVector(vec_ntn).execute()==2);
+    CHECK(vec_nas[0]["n"]=="12" && vec_ntn[0]["n"]==1);
+    CHECK(vec_nas[1]["n"]=="ab" && vec_ntn[1]["n"]==2);
+}
+
+TEST_CASE(results_match_set){
+    jpcre2::Regex re("(?<key>\\w+)=(?<value>\\d+)?","");
+    re.execute();
+    std::string subject="a=1 b= c=33";
+    jpcre2::MatchSet set;
+    set.reserve(8,3);
+    CHECK(re.match(subject).modifiers("g").matchSet(set).execute()==3);
+    CHECK(set.size()==3 && set.groups()==3);
+    CHECK(set.str(subject,0,1)=="a" && set.str(subject,2,2)=="33");
+    CHECK(set.start(2,0)==7 && set.end(2,0)==11 && set.length(2,0)==4);
+    CHECK(!set.isSet(1,2) && set.length(1,2)==0 && set.str(subject,1,2).empty());
+    CHECK(set.setCount(1)==2 && set.setCount(2)==3);
+    CHECK(set.number("value",0)==2 && set.number("nope",0)==-1);
+    
+    ///a reused set is refilled, not appended to
+    CHECK(re.match("z=9").matchSet(set).execute()==1);
+    CHECK(set.size()==1 && set.str("z=9",0,2)=="9");
+    CHECK(re.match("").matchSet(set).execute()==0);
+    CHECK(set.size()==0);
+}
@@ -0,0 +1,46 @@
+#include "test_check.h"
+#include <cstdio>
+
+///RegexSet::match() picks the same patterns as matching each of them on its own,
+///caseless patterns in a locale with letters above 0x7f included.
+
+static std::vector<size_t> matchEach(const jpcre2::RegexSet& set,const std::string& subject){
+    std::vector<size_t> matched;
+    for(size_t i=0;i<set.size();i++) if(jpcre2::RegexMatch(set.pattern(i)).subject(subject).test()) matched.push_back(i);
+    return matched;
+}
+
+TEST_CASE(set_matches_same_as_each){
+    jpcre2::RegexSet set;
+    set.add("ERROR","i").add("user_id=\\d+").add("timeout$","S").add("^(GET|POST) ").add("x*").add("[qz]{3}");
+    const char* lines[]={"error: x","user_id=42","request Timeout","GET /","POST / timeout","qzq","nothing",""};
+    for(const char* line : lines){
+        std::vector<size_t> matched;
+        CHECK(set.match(line,matched)==matched.size());
+        CHECK(matched==matchEach(set,line));
+    }
+}
+
+TEST_CASE(set_caseless_in_locale){
+    ///The locales found on the system, plus JPCRE2_TEST_LOCALE (e.g one made by localedef)
+    std::vector<std::string> locales={"de_DE.ISO-8859-1","fr_FR.ISO-8859-1","en_US.ISO-8859-1","tr_TR.ISO-8859-9","C.UTF-8"};
+    if(const char* extra=std::getenv("JPCRE2_TEST_LOCALE")) locales.insert(locales.begin(),extra);
+    for(const std::string& loc : locales){
+        if(!std::setlocale(LC_CTYPE,loc.c_str())) continue;
+        std::setlocale(LC_CTYPE,"C");
+        
+        ///each byte as a caseless pattern, against each byte
+        jpcre2::RegexSet set;
+        for(int c=1;c<256;c++){
+            char p[8];
+            std::snprintf(p,sizeof(p),"\\x%02x",c);
+            set.add(p,"i",loc);
+        }
+        for(int c=1;c<256;c++){
+            std::string subject(1,(char)c);
+            std::vector<size_t> matched;
+            set.match(subject,matched);
+            CHECK(matched==matchEach(set,subject));
+        }
+    }
+}
@@ -0,0 +1,84 @@
+#include "test_check.h"
+#include <random>
+#include <cstdio>
+#include <unistd.h>
+
+///RegexReplace::execute(sink), execute(ostream) and executeFd() write what execute() returns,
+///whether the replacement is put together from the match or expanded by pcre2_substitute().
+
+TEST_CASE(sink_same_as_execute){
+    const char* const patterns[][2]={{"\\d+",""},{"x*",""},{"^\\w+","m"},{"\xc3\xa9+","u"},{"(?<w>[a-z]+)=(\\d+)",""},
+                                     {"",""},{"\\R",""},{"(a)|(b)",""},{"(?=b)",""},{"$","m"},{"a\\Kb",""},{"(*MARK:m)x",""}};
+    const char* const replacements[]={"[$0]","$$","","<$0|$$|$0$0>","${0}x","$00","[$1]","[${1}|$2]","${w}:$w:$2",
+                                      "$","${0","$*MARK","${w","$01a","$1$2"};
+    const char* const pieces[]={"a","b","foo"," ","1","23","x","=","\n","\r\n","\xc3\xa9","ab","z"};
+    std::mt19937 rng(7);
+    FILE* out=tmpfile();
+    CHECK(out!=nullptr);
+    for(auto& p : patterns){
+        jpcre2::Regex re(p[0],p[1]);
+        re.execute();
+        for(const char* repl : replacements){
+            for(const char* mod : {"","g","gE","ge","gx"}){
+                for(int k=0;k<10;k++){
+                    std::string s;
+                    for(int i=rng()%40;i>0;i--) s+=pieces[rng()%13];
+                    int expected_error=0,error=0;
+                    std::string expected;
+                    try{expected=re.replace(s,repl).modifiers(mod).execute();}catch(int e){expected_error=e;}
+                    
+                    jpcre2::RegexReplace rr(re);
+                    rr.subject(&s).replaceWith(repl).modifiers(mod);
+                    std::string got;
+                    try{rr.execute([&](const char* data,jpcre2::Uint size){got.append(data,size);});}catch(int e){error=e;}
+                    CHECK(error==expected_error);
+                    if(error || expected_error) continue;
+                    CHECK(got==expected);
+                    
+                    std::ostringstream os;
+                    rr.execute(os);
+                    CHECK(os.str()==expected);
+                    
+                    CHECK(ftruncate(fileno(out),0)==0 && lseek(fileno(out),0,SEEK_SET)==0);
+                    rr.executeFd(fileno(out));
+                    std::string written(expected.size()+1,'\0');
+                    CHECK(pread(fileno(out),&written[0],written.size(),0)==(ssize_t)expected.size());
+                    written.resize(expected.size());
+                    CHECK(written==expected);
+                }
+            }
+        }
+    }
+    fclose(out);
+}
+
+TEST_CASE(sink_stats_and_limits){
+    ///The matches of a sink replace are counted like those of RegexMatch, JIT included
+    jpcre2::Regex re("\\d+","S");
+    re.execute();
+    re.collectStats();
+    std::string s="a1b22c333";
+    std::string got;
+    jpcre2::RegexReplace rr(re);
+    CHECK(rr.subject(&s).replaceWith("<$0>").modifiers("g").execute([&](const char* data,jpcre2::Uint size){
+        got.append(data,size);
+    })==3);
+    CHECK(got=="a<1>b<22>c<333>");
+    jpcre2::MatchStats stats=re.getStats();
+    CHECK(stats.hits==3 && stats.misses==1);
+    uint32_t jit_supported=0;
+    pcre2_config(PCRE2_CONFIG_JIT,&jit_supported);
+    if(jit_supported) CHECK(stats.jit==4);
+    re.collectStats(false);
+    
+    ///A limit leaves the rest of the subject as it is
+    jpcre2::Regex slow("(a+)+$");
+    slow.execute();
+    std::string subject="ab"+std::string(30,'a')+"b";
+    std::string out;
+    jpcre2::RegexReplace limited(slow);
+    limited.subject(&subject).replaceWith("x").modifiers("g").matchLimit(1000);
+    limited.execute([&](const char* data,jpcre2::Uint size){out.append(data,size);});
+    CHECK(limited.limitReached());
+    CHECK(out==subject);
+}
@@ -0,0 +1,79 @@
+#include "test_check.h"
+#include <thread>
+
+///Regex::collectStats(): the calls of every way of matching are counted, across threads,
+///and RegexStats lists the Regex objects collecting them.
+
+static bool listed(const std::string& pattern){
+    std::vector<jpcre2::MatchStats> all=jpcre2::RegexStats::snapshot();
+    for(size_t i=0;i<all.size();i++) if(all[i].pattern==pattern) return true;
+    return false;
+}
+
+///Stops collecting in its destructor at exit, after main() returned
+static jpcre2::Regex at_exit("stats_at_exit");
+
+TEST_CASE(stats_counts){
+    at_exit.execute();
+    at_exit.collectStats();
+    CHECK(at_exit.match("stats_at_exit").test());
+    
+    jpcre2::Regex re("\\d+");
+    re.execute();
+    re.collectStats();
+    CHECK(re.isCollectingStats());
+    CHECK(listed("\\d+"));
+    
+    ///findAll() makes one call per match and one more that finds none
+    CHECK(re.match("a1b22c333").findAll().execute()==3);
+    jpcre2::MatchStats st=re.getStats();
+    CHECK(st.calls==4 && st.hits==3 && st.misses==1);
+    CHECK(st.bytes==9);               ///"a1" "b22" "c333" then the empty rest: 2+3+4+0
+    CHECK(st.jit+st.interpreted==4);
+    jpcre2::Uint in_histogram=0;
+    for(int b=0;b<jpcre2::MatchStats::BUCKETS;b++) in_histogram+=st.histogram[b];
+    CHECK(in_histogram==4);
+    CHECK(st.percentile(50)>0 && st.percentile(50)<=st.percentile(99));
+    
+    ///a replace by pcre2_substitute() is one call for all of its matches
+    CHECK(re.replace("a1b2","x").modifiers("g").execute()=="axbx");
+    CHECK(re.getStats().calls==5);
+    
+    re.resetStats();
+    CHECK(re.getStats().calls==0);
+    
+    ///A copy counts its own calls, a moved to Regex takes over the listing
+    jpcre2::Regex copy(re);
+    CHECK(copy.isCollectingStats());
+    copy.match("1").test();
+    CHECK(copy.getStats().calls==1 && re.getStats().calls==0);
+    jpcre2::Regex moved(std::move(copy));
+    CHECK(moved.isCollectingStats() && !copy.isCollectingStats());
+    CHECK(moved.getStats().calls==1);
+    
+    std::ostringstream out;
+    jpcre2::RegexStats::dump(out);
+    CHECK(out.str().find("\\d+")!=std::string::npos);
+    
+    re.collectStats(false);
+    moved.collectStats(false);
+    CHECK(!listed("\\d+"));
+    CHECK(re.getStats().calls==0);
+}
+
+TEST_CASE(stats_threads){
+    jpcre2::Regex re("b+","S");
+    re.execute();
+    re.collectStats();
+    const int THREADS=8,CALLS=2000;
+    std::vector<std::thread> threads;
+    for(int t=0;t<THREADS;t++) threads.push_back(std::thread([&re]{
+        jpcre2::RegexMatch rm(re);
+        rm.subject("abba");
+        for(int i=0;i<CALLS;i++) rm.test();
+    }));
+    for(size_t t=0;t<threads.size();t++) threads[t].join();
+    jpcre2::MatchStats st=re.getStats();
+    CHECK(st.calls==(jpcre2::Uint)THREADS*CALLS && st.hits==st.calls);
+    re.collectStats(false);
+}
@@ -0,0 +1,90 @@
+#include "test_check.h"
+#include <random>
+
+///RegexMatch::executeStream() finds what execute() does with findAll(), whatever the chunk size:
+///matches that cross the end of a chunk, lookbehinds, empty matches and UTF-8 characters cut in two.
+
+static const char* const pieces[]={"a","b","foo"," ","1","23","x","=","\n","\r\n","\xc3\xa9","ab","z"};
+
+static std::string randomSubject(std::mt19937& rng){
+    std::string s;
+    for(int i=rng()%40;i>0;i--) s+=pieces[rng()%13];
+    return s;
+}
+
+TEST_CASE(stream_same_as_execute){
+    const char* const patterns[][2]={{"\\d+",""},{"x*",""},{"(?m)^\\w+",""},{"\xc3\xa9+","u"},{"(?<w>[a-z]+)=(\\d+)",""},
+                                     {"",""},{"\\R",""},{"\xc3\xa9|x*","u"},{"(?=b)",""},{"(?m)$",""},{"(?<=\\d)[a-z]",""},
+                                     {"\\bfoo\\b",""}};
+    std::mt19937 rng(5);
+    for(auto& p : patterns){
+        jpcre2::Regex re(p[0],p[1]);
+        re.execute();
+        for(int k=0;k<40;k++){
+            std::string s=randomSubject(rng);
+            jpcre2::VecSpan spans;
+            jpcre2::VecNum num;
+            size_t count=re.match(s).modifiers("g").numberedSpanVector(spans).numberedSubstringVector(num).execute();
+            for(size_t chunk : {1,2,3,7,64}){
+                std::istringstream in(s);
+                std::vector<jpcre2::SpanNum> got;
+                std::vector<std::string> text;
+                jpcre2::RegexMatch rm(re);
+                CHECK(rm.findAll().chunkSize(chunk).executeStream(in,[&](const jpcre2::MatchView& v){
+                    got.push_back(jpcre2::SpanNum(1));
+                    got.back()[0].start=v.start();
+                    got.back()[0].length=v.length();
+                    text.push_back(v.str());
+                    return true;
+                })==count);
+                bool same=got.size()==count;
+                for(size_t i=0;same && i<count;i++)
+                    same=got[i][0].start==spans[i][0].start && got[i][0].length==spans[i][0].length && text[i]==num[i][0];
+                CHECK(same);
+            }
+        }
+    }
+}
+
+TEST_CASE(stream_callback_and_first_match){
+    jpcre2::Regex re("(?<n>\\d+)","S");
+    re.execute();
+    std::string s="a1 b22 c333 d4444";
+    
+    ///without findAll() the first match only
+    std::istringstream in1(s);
+    std::string first;
+    CHECK(jpcre2::RegexMatch(re).chunkSize(2).executeStream(in1,[&](const jpcre2::MatchView& v){
+        first=v.str("n");
+        return true;
+    })==1);
+    CHECK(first=="1");
+    
+    ///the callback stops the scan
+    std::istringstream in2(s);
+    std::vector<std::string> seen;
+    CHECK(jpcre2::RegexMatch(re).findAll().chunkSize(3).executeStream(in2,[&](const jpcre2::MatchView& v){
+        seen.push_back(v.str());
+        return seen.size()<2;
+    })==2);
+    CHECK(seen==std::vector<std::string>({"1","22"}));
+}
+
+TEST_CASE(stream_from_reader){
+    ///an input generated as it's read, much bigger than a chunk
+    jpcre2::Regex re("ERROR \\d+","S");
+    re.execute();
+    const char line[]="ERROR 123 some text here\n";
+    size_t produced=0,total=2000000;
+    size_t biggest=0;
+    jpcre2::RegexMatch rm(re);
+    size_t count=rm.findAll().chunkSize(4096).executeStream([&](char* buffer,size_t size)->size_t{
+        biggest=std::max(biggest,size);
+        size_t k=std::min(size,total-produced);
+        for(size_t i=0;i<k;i++) buffer[i]=line[(produced+i)%(sizeof(line)-1)];
+        produced+=k;
+        return k;
+    },[](const jpcre2::MatchView& v){return v.length()==9;});
+    CHECK(count==total/(sizeof(line)-1));
+    CHECK(biggest==4096);
+}